@@ -0,0 +1,85 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "bankers_allocator.h"
+using namespace std;
+
+
+double run_threads(int num_threads, int units, int claim, bool fast_path, bool& consistent) {
+    /*
+     * Every thread claims up to claim units of each of 4 resource types, then
+     * keeps acquiring a few units of one type (waiting when it must) and releasing
+     * them for a fixed time. Returns the acquires per second, in millions, and
+     * checks that every unit is back at the end.
+     */
+    const int num_res = 4;
+    const double seconds = 0.2;
+    BankersAllocator allocator(vector<int>(num_res, units), num_threads);
+    allocator.fast_path = fast_path;
+
+    atomic<bool> stop(false);
+    atomic<long long> total_ops(0);
+    vector<thread> workers;
+    for (int i = 0; i < num_threads; i++) {
+        workers.emplace_back([&allocator, &stop, &total_ops, claim, i] {
+            int task = allocator.claim(vector<int>(num_res, claim));
+            unsigned seed = i * 2654435761u + 1;
+            long long ops = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                seed = seed * 1103515245 + 12345;
+                int res = (seed >> 16) % num_res;
+                int amount = 1 + (seed >> 8) % min(claim, 4);
+                allocator.acquire(task, res, amount);
+                allocator.release(task, res, amount);
+                ops++;
+            }
+            allocator.finish(task);
+            total_ops += ops;
+        });
+    }
+
+    this_thread::sleep_for(chrono::duration<double>(seconds));
+    stop = true;
+    for (thread& worker: workers) {
+        worker.join();
+    }
+
+    for (int r = 0; r < num_res; r++) {
+        consistent = consistent and allocator.available_units(r) == units;
+    }
+    return total_ops / seconds / 1e6;
+}
+
+
+int main() {
+    // Roomy: the units left almost always cover every claim, so grants take the
+    // fast path. Tight: many claims compete for few units, so most go through the
+    // safety algorithm and many have to wait.
+    struct Scenario {
+        const char* name;
+        int units_per_thread, fixed_units, claim;
+    };
+    Scenario scenarios[] = {{"roomy", 64, 0, 8}, {"tight", 0, 12, 8}};
+
+    bool consistent = true;
+    cout << setw(8) << "threads" << setw(8) << "load" << setw(14) << "atomic Mops/s";
+    cout << setw(14) << "locked Mops/s" << setw(10) << "speedup" << endl;
+    for (const Scenario& scenario: scenarios) {
+        for (int num_threads: {1, 2, 4, 8, 16, 32, 64}) {
+            int units = scenario.fixed_units + scenario.units_per_thread * num_threads;
+            double fast = run_threads(num_threads, units, scenario.claim, true, consistent);
+            double locked = run_threads(num_threads, units, scenario.claim, false, consistent);
+            cout << setw(8) << num_threads << setw(8) << scenario.name << fixed << setprecision(2);
+            cout << setw(14) << fast << setw(14) << locked << setw(9) << fast / locked << "x" << endl;
+        }
+    }
+
+    if (!consistent) {
+        cerr << "Units were lost or created." << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,272 @@
+#ifndef BANKERS_ALLOCATOR_H
+#define BANKERS_ALLOCATOR_H
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include "safety_kernel.h"
+
+
+class BankersAllocator {
+    /*
+     * Banker's algorithm for threads of a running program: every task claims the
+     * most units of each resource type it will ever hold, then acquires and
+     * releases them, and an acquire is only granted if the state it leads to is
+     * safe. Any number of threads can use it at the same time, as long as each
+     * task is used by one thread at a time.
+     *
+     * Most grants take a single compare-and-swap. If the units of a type left after
+     * a grant still cover the whole claim of every task on that type, no task can
+     * ever be kept from finishing by that type, so the state stays safe whatever
+     * the other types look like. Any other acquire takes the lock and runs the
+     * complete safety algorithm over a snapshot of the state.
+     *
+     * Acquires take units out of available before adding them to their task, so a
+     * snapshot taken during one is at worst missing some units, which is still
+     * safe to grant against. Releases move units the other way without the lock,
+     * so a snapshot taken during one could count its units both as held and as
+     * available. Every release is counted when it starts and when it is done, and
+     * a snapshot that any release overlapped is taken again.
+     */
+public:
+    // Set to false to run every acquire through the safety algorithm, for comparisons.
+    bool fast_path;
+
+    BankersAllocator(const std::vector<int>& units, int max_tasks)
+            : fast_path(true), num_res(units.size()), max_tasks(max_tasks), total(units),
+              available(units.size()), max_claim(units.size()), claim_epoch(0), releases_started(0),
+              releases_done(0), waiters(0),
+              stride((units.size() + 15) / 16 * 16), held(max_tasks * stride), claims(max_tasks * units.size(), 0),
+              live(max_tasks, false) {
+        for (int r = 0; r < num_res; r++) {
+            available[r].store(units[r]);
+            max_claim[r].store(0);
+        }
+        for (int i = 0; i < held.size(); i++) {
+            held[i].store(0);
+        }
+        done.resize(max_tasks);
+    }
+
+    int claim(const std::vector<int>& units) {
+        /*
+         * Registers a task that will hold at most the given units of every type.
+         * Returns its number, or -1 if a claim exceeds the units present or there
+         * is no room for another task.
+         */
+        std::lock_guard<std::mutex> lock(mutex);
+        int task = std::find(live.begin(), live.end(), false) - live.begin();
+        if (task == max_tasks or units.size() != num_res) {
+            return -1;
+        }
+        for (int r = 0; r < num_res; r++) {
+            if (units[r] < 0 or units[r] > total[r]) {
+                return -1;
+            }
+        }
+
+        // A task that holds nothing can always finish last, so the state stays safe. Fast
+        // paths that read the maximum claims before they were raised may be wrong once it
+        // holds something: moving the epoch after raising them tells those to check again.
+        for (int r = 0; r < num_res; r++) {
+            claims[task * num_res + r] = units[r];
+            if (units[r] > max_claim[r].load()) {
+                max_claim[r].store(units[r]);
+            }
+        }
+        claim_epoch++;
+        live[task] = true;
+        return task;
+    }
+
+    bool try_acquire(int task, int res, int amount) {
+        /*
+         * Grants amount units of resource type res (from 0) to a task if that is
+         * safe right now. Returns false if it is not, or if the task would hold more
+         * than it claimed.
+         */
+        if (!valid(task, res, amount)) {
+            return false;
+        }
+        if (fast_path and acquire_fast(task, res, amount)) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        return acquire_safe(task, res, amount);
+    }
+
+    bool acquire(int task, int res, int amount) {
+        /*
+         * Like try_acquire, but waits until the grant is safe. Only returns false
+         * if the task would hold more than it claimed.
+         */
+        if (!valid(task, res, amount)) {
+            return false;
+        }
+        if (fast_path and acquire_fast(task, res, amount)) {
+            return true;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        waiters++;
+        while (!acquire_safe(task, res, amount)) {
+            freed.wait(lock);
+        }
+        waiters--;
+        return true;
+    }
+
+    void release(int task, int res, int amount) {
+        /*
+         * Gives back amount units of resource type res held by a task, waking up
+         * the threads waiting to acquire.
+         */
+        releases_started++;
+        held[task * stride + res] -= amount;
+        available[res] += amount;
+        releases_done++;
+        wake_waiters();
+    }
+
+    void finish(int task) {
+        /*
+         * Releases everything a task still holds and forgets it, so that its number
+         * can be reused by another claim.
+         */
+        releases_started++;
+        for (int r = 0; r < num_res; r++) {
+            int units = held[task * stride + r].exchange(0);
+            available[r] += units;
+        }
+        releases_done++;
+
+        // Lower the maximum claims that were this task's. Until then, they are only too cautious.
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            live[task] = false;
+            for (int r = 0; r < num_res; r++) {
+                claims[task * num_res + r] = 0;
+                int largest = 0;
+                for (int t = 0; t < max_tasks; t++) {
+                    largest = std::max(largest, claims[t * num_res + r]);
+                }
+                max_claim[r].store(largest);
+            }
+        }
+        wake_waiters();
+    }
+
+    int available_units(int res) {
+        return available[res].load();
+    }
+
+private:
+    int num_res, max_tasks;
+    std::vector<int> total;
+    std::vector<std::atomic<int> > available, max_claim;
+    std::atomic<long long> claim_epoch, releases_started, releases_done;
+    std::atomic<int> waiters;
+
+    // The units held by every task, in rows padded to whole cache lines so that
+    // tasks on different threads do not share one. Claims only change under the lock.
+    int stride;
+    std::vector<std::atomic<int> > held;
+    std::vector<int> claims;
+    std::vector<bool> live;
+
+    std::mutex mutex;
+    std::condition_variable freed;
+
+    // Snapshot and scratch buffers of the safety algorithm, used under the lock.
+    std::vector<int> snapshot_need, snapshot_held, snapshot_available, live_list, sequence;
+    std::vector<bool> done;
+
+    bool valid(int task, int res, int amount) {
+        // Whether the task may hold amount more units of type res. Only its own thread changes what it holds.
+        return amount >= 0 and held[task * stride + res].load() + amount <= claims[task * num_res + res];
+    }
+
+    bool acquire_fast(int task, int res, int amount) {
+        /*
+         * Grants with atomic operations only, if the units left cover every task's
+         * whole claim on the type. If a claim was registered meanwhile, the grant
+         * is undone and left to the safety algorithm.
+         */
+        long long epoch = claim_epoch.load();
+        int units = available[res].load();
+        while (units - amount >= max_claim[res].load()) {
+            if (available[res].compare_exchange_weak(units, units - amount)) {
+                if (claim_epoch.load() != epoch) {
+                    available[res] += amount;
+                    wake_waiters();
+                    return false;
+                }
+                held[task * stride + res] += amount;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool acquire_safe(int task, int res, int amount) {
+        /*
+         * Grants if the state after the grant is safe, with the lock held. Retries
+         * with a new snapshot if a release overlapped it, or if some other thread
+         * took units of the same type in between.
+         */
+        while (true) {
+            // Every task is read before the units available, so acquires never make a unit count twice.
+            long long released = releases_done.load();
+            live_list.clear();
+            snapshot_need.assign(max_tasks * num_res, 0);
+            snapshot_held.assign(max_tasks * num_res, 0);
+            for (int t = 0; t < max_tasks; t++) {
+                if (!live[t]) {
+                    continue;
+                }
+                live_list.push_back(t);
+                for (int r = 0; r < num_res; r++) {
+                    snapshot_held[t * num_res + r] = held[t * stride + r].load();
+                    snapshot_need[t * num_res + r] = claims[t * num_res + r] - snapshot_held[t * num_res + r];
+                }
+            }
+            snapshot_available.resize(num_res);
+            for (int r = 0; r < num_res; r++) {
+                snapshot_available[r] = available[r].load();
+            }
+            if (releases_started.load() != released) {
+                continue;
+            }
+
+            int units = snapshot_available[res];
+            if (units < amount) {
+                return false;
+            }
+
+            // Check the state as if the grant had been made.
+            snapshot_available[res] -= amount;
+            snapshot_need[task * num_res + res] -= amount;
+            snapshot_held[task * num_res + res] += amount;
+            if (!find_safe_sequence(snapshot_need.data(), snapshot_held.data(), num_res, live_list,
+                                    snapshot_available, done, sequence)) {
+                return false;
+            }
+
+            if (available[res].compare_exchange_strong(units, units - amount)) {
+                held[task * stride + res] += amount;
+                return true;
+            }
+        }
+    }
+
+    void wake_waiters() {
+        // Units came back: the threads waiting to acquire check again.
+        if (waiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            freed.notify_all();
+        }
+    }
+};
+
+#endif
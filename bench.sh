@@ -0,0 +1,39 @@
+#!/bin/sh
+# Times parsing, FIFO and Banker's separately over generated workloads of
+# increasing size. Writes one CSV row per tier and run to bench_results.csv
+# (or the file given as the first argument).
+# Usage: ./bench.sh [results.csv] [runs]
+
+RESULTS=${1:-bench_results.csv}
+RUNS=${2:-3}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# name tasks resources units requests tightness granularity delay_prob delay_max
+TIERS="
+small     100    4   400   10  0.0125 0.5 0.2 5
+contended 100    4   20    10  0.5    0.5 0.2 5
+medium    1000   8   2000  20  0.0025 0.5 0.2 5
+large     10000  16  30000 20  0.0002 0.5 0.2 5
+"
+
+echo "tier,tasks,resources,instructions,run,parse_ms,fifo_ms,bankers_ms" > "$RESULTS"
+echo "$TIERS" | while read name tasks res units reqs tight gran dprob dmax; do
+    [ -z "$name" ] && continue
+    input="$DIR/$name.txt"
+    ./workload_gen --tasks "$tasks" --resources "$res" --units "$units" --requests "$reqs" \
+        --tightness "$tight" --granularity "$gran" --delay-prob "$dprob" --delay-max "$dmax" > "$input" || exit 1
+    instructions=$(($(wc -l < "$input") - 1))
+
+    run=1
+    while [ "$run" -le "$RUNS" ]; do
+        times=$(./resmanager --timing "$input" 2>&1 >/dev/null | grep '^parse_ms=') || exit 1
+        parse=$(echo "$times" | sed 's/.*parse_ms=\([^ ]*\).*/\1/')
+        fifo=$(echo "$times" | sed 's/.*fifo_ms=\([^ ]*\).*/\1/')
+        bankers=$(echo "$times" | sed 's/.*bankers_ms=\([^ ]*\).*/\1/')
+        echo "$name,$tasks,$res,$instructions,$run,$parse,$fifo,$bankers" >> "$RESULTS"
+        run=$((run + 1))
+    done
+done
+
+column -s, -t < "$RESULTS" 2>/dev/null || cat "$RESULTS"
@@ -0,0 +1,98 @@
+#!/bin/sh
+# Checks resmanager over the sample inputs and the inputs written below: modes
+# meant to give the results of a normal run must give them, and malformed
+# inputs must be rejected. Every check says what it covers where it runs.
+# Usage: ./check.sh
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+POLICIES=--policies=fifo,bankers,srnf,batched
+FAILED=0
+
+fail() {
+    echo "FAIL: $1"
+    FAILED=1
+}
+
+# Two tasks deadlocking FIFO while the third waits on a request of two resource types.
+cat > "$DIR/also.txt" <<EOF
+3 3 2 1 1
+initiate 1 0 1 2
+initiate 1 0 2 1
+request 1 0 1 2
+request 1 0 2 1
+release 1 0 1 2
+release 1 0 2 1
+terminate 1 0 0 0
+initiate 2 0 2 1
+initiate 2 0 3 1
+request 2 0 2 1
+request 2 0 3 1
+release 2 0 2 1
+release 2 0 3 1
+terminate 2 0 0 0
+initiate 3 0 3 1
+initiate 3 0 1 1
+initiate 3 0 2 1
+request 3 0 3 1
+request 3 0 1 1
+also 3 0 2 1
+release 3 0 3 1
+terminate 3 0 0 0
+EOF
+
+# seed tasks resources units requests tightness groups
+for gen in "1 8 3 6 4 0.6 1" "2 8 3 6 4 0.6 1" "3 12 4 10 5 0.5 2" "4 12 4 10 5 0.5 3"; do
+    set -- $gen
+    ./workload_gen --seed "$1" --tasks "$2" --resources "$3" --units "$4" --requests "$5" \
+        --tightness "$6" --groups "$7" > "$DIR/gen-$1.txt" || exit 1
+done
+
+for input in sample_input_output/input-* "$DIR/also.txt" "$DIR"/gen-*.txt; do
+    name=$(basename "$input")
+    ./resmanager "$input" $POLICIES --format=csv > "$DIR/out" 2> "$DIR/err" || fail "$name does not run"
+
+    # Batched Banker's decides the same requests as Banker's.
+    grep '^bankers,' "$DIR/out" | cut -d, -f2- > "$DIR/bankers"
+    grep '^batched,' "$DIR/out" | cut -d, -f2- > "$DIR/batched"
+    cmp -s "$DIR/bankers" "$DIR/batched" || fail "$name: batched differs from bankers"
+
+    ./resmanager "$input" $POLICIES --format=csv --shard > "$DIR/shard" 2>/dev/null
+    cmp -s "$DIR/out" "$DIR/shard" || fail "$name: --shard differs"
+
+    ./resmanager --compile "$input" "$DIR/compiled.bin" || fail "$name does not compile"
+    ./resmanager "$DIR/compiled.bin" $POLICIES --format=csv > "$DIR/compiled" 2> "$DIR/compiled-err"
+    cmp -s "$DIR/out" "$DIR/compiled" && cmp -s "$DIR/err" "$DIR/compiled-err" || fail "$name: compiled input differs"
+
+    # Runs that end before a checkpoint's cycle are refused, so only earlier cycles are checked.
+    for cycle in 1 3 10; do
+        ./resmanager "$input" $POLICIES --format=csv --checkpoint=$cycle --save="$DIR/ckpt" > "$DIR/resumed" 2> "$DIR/resumed-err"
+        grep -q "ends before cycle" "$DIR/resumed-err" && continue
+        cmp -s "$DIR/out" "$DIR/resumed" && cmp -s "$DIR/err" "$DIR/resumed-err" || fail "$name: --checkpoint=$cycle differs"
+        ./resmanager "$input" $POLICIES --format=csv --restore="$DIR/ckpt" > "$DIR/restored" 2> "$DIR/restored-err"
+        cmp -s "$DIR/out" "$DIR/restored" && cmp -s "$DIR/err" "$DIR/restored-err" || fail "$name: --restore at cycle $cycle differs"
+    done
+done
+
+# Resource type 0 is only allowed on terminates.
+printf '1 1 4\ninitiate 1 0 0 2\nterminate 1 0 0 0\n' > "$DIR/initiate-0.txt"
+printf '1 1 4\ninitiate 1 0 1 2\nrequest 1 0 0 1\nterminate 1 0 0 0\n' > "$DIR/request-0.txt"
+for input in "$DIR/initiate-0.txt" "$DIR/request-0.txt"; do
+    ./resmanager "$input" 2>&1 | grep -q "resource type out of range" || fail "$(basename "$input") is accepted"
+done
+
+# Compiled inputs too. The request's resource type sits 70 bytes into this one (see Program::write_compiled).
+printf '1 1 4\ninitiate 1 0 1 2\nrequest 1 0 1 1\nterminate 1 0 0 0\n' > "$DIR/request-1.txt"
+./resmanager --compile "$DIR/request-1.txt" "$DIR/request-0.bin" || fail "request-1.txt does not compile"
+printf '\0\0' | dd of="$DIR/request-0.bin" bs=1 seek=70 conv=notrunc 2>/dev/null
+./resmanager "$DIR/request-0.bin" 2>&1 | grep -q "malformed instructions" || fail "request-0.bin is accepted"
+
+# A checkpoint's claims must be the program's. Task 1's claim on resource 1 sits 164 bytes into this one
+# (see write_checkpoints): raising it from 4 to 5 must be refused.
+./resmanager sample_input_output/input-03 --policies=bankers --format=csv --checkpoint=3 --save="$DIR/claim.ckpt" > /dev/null
+printf '\005' | dd of="$DIR/claim.ckpt" bs=1 seek=164 conv=notrunc 2>/dev/null
+./resmanager sample_input_output/input-03 --policies=bankers --format=csv --restore="$DIR/claim.ckpt" 2>&1 | \
+    grep -q "Invalid checkpoint" || fail "a checkpoint with a raised claim is accepted"
+
+[ "$FAILED" -eq 0 ] && echo "All checks passed."
+exit $FAILED
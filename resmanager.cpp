@@ -1,14 +1,138 @@
 #include <iostream>
-#include <fstream>
+#include <new>
+#include <cstdlib>
 #include <vector>
 #include <sstream>
 #include <numeric>
 #include <algorithm>
-#include <iterator>
+#include <climits>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <fstream>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <unordered_map>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "safety_kernel.h"
 using namespace std;
 
 
-int num_digs(int num) {
+#ifdef RESMANAGER_DEBUG
+// Heap allocations made by each thread. Debug builds use it to check that
+// the cycle loops do not allocate once a run has been set up.
+thread_local long long allocation_count = 0;
+
+// Every replaced operator new and delete goes through this pair. They are
+// kept out of line so that gcc never sees free called, in an inlined delete,
+// on a pointer it knows came from operator new (-Wmismatched-new-delete).
+__attribute__((noinline)) void* counted_alloc(size_t size, size_t align) {
+    allocation_count++;
+    void* ptr = NULL;
+    if (align <= alignof(max_align_t)) {
+        ptr = malloc(size == 0 ? 1 : size);
+    } else if (posix_memalign(&ptr, align, size == 0 ? align : size) != 0) {
+        ptr = NULL;
+    }
+    return ptr;
+}
+
+__attribute__((noinline)) void counted_free(void* ptr) noexcept {
+    free(ptr);
+}
+
+void* operator new(size_t size) {
+    void* ptr = counted_alloc(size, 0);
+    if (ptr == NULL) {
+        throw bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    return counted_alloc(size, 0);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+    return counted_alloc(size, 0);
+}
+
+void operator delete(void* ptr) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete(void* ptr, const nothrow_t&) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete[](void* ptr, const nothrow_t&) noexcept {
+    counted_free(ptr);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void* ptr, size_t) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    counted_free(ptr);
+}
+#endif
+
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, align_val_t align) {
+    void* ptr = counted_alloc(size, size_t(align));
+    if (ptr == NULL) {
+        throw bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size, align_val_t align) {
+    return operator new(size, align);
+}
+
+void operator delete(void* ptr, align_val_t) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete[](void* ptr, align_val_t) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete(void* ptr, size_t, align_val_t) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, align_val_t) noexcept {
+    counted_free(ptr);
+}
+#endif
+#endif
+
+
+int num_digs(long long num) {
     /*
      * Used for printing. Returns the number of digits
      * of a number (or 1 if it's zero or less).
@@ -23,55 +147,289 @@ int num_digs(int num) {
 }
 
 
-vector<string> get_vector(string file_name) {
+enum Opcode : unsigned char {
     /*
-     * Used to process input. Returns the the content of a file
-     * divided in tokens (elements separated by white space).
+     * The type of an instruction. Unknown words in the input are
+     * mapped to OP_INVALID so that the input can be rejected. An 'also'
+     * is another part of the request before it: a request and the alsos
+     * right after it ask for units of several resource types at once,
+     * and are granted together or not at all.
      */
-    ifstream f(file_name);
+    OP_INITIATE,
+    OP_REQUEST,
+    OP_RELEASE,
+    OP_TERMINATE,
+    OP_ALSO,
+    OP_INVALID
+};
 
-    // Return an empty vector if the file has not been found.
-    if (!f) {
-        cout << "File not found." << endl;
-        return {};
-    }
 
-    stringstream no_format;
-    no_format << f.rdbuf();
-    f.close();
+Opcode get_opcode(const char* word, size_t len) {
+    /*
+     * Used to process input. Returns the opcode matching an instruction word.
+     */
+    if (len == 8 and memcmp(word, "initiate", len) == 0) return OP_INITIATE;
+    if (len == 7 and memcmp(word, "request", len) == 0) return OP_REQUEST;
+    if (len == 7 and memcmp(word, "release", len) == 0) return OP_RELEASE;
+    if (len == 9 and memcmp(word, "terminate", len) == 0) return OP_TERMINATE;
+    if (len == 4 and memcmp(word, "also", len) == 0) return OP_ALSO;
+    return OP_INVALID;
+}
 
-    return vector<string>((istream_iterator<string>(no_format)), istream_iterator<string>());
 
+bool resource_in_range(Opcode op, int res, int res_types) {
+    /*
+     * Used to check input. A terminate names no resource, so its resource type
+     * may be 0; every other instruction must name one of the resource types.
+     */
+    return res <= res_types and res >= (op == OP_TERMINATE ? 0 : 1);
 }
 
 
-class Instruction {
+class InputFile {
     /*
-     * An instruction read by the ResManager, its components are
-     * set within the ResManager when the input is processed.
+     * Used to process input. An input file mapped into memory and read token by
+     * token (elements separated by white space) in place, without copying it.
+     * Keeps track of the line and column of the last token so that malformed
+     * input can be reported.
      */
 public:
-    string type;
-    int task_number, delay, resource_type, initial_claim, number_requested, number_released;
-
-    Instruction(string instr, int task, int del, int res, int num_res) {
-        // initial_claim, number_requested, and number_released are set to zero.
-        type = instr;
-        task_number = task;
-        delay = del;
-        resource_type = res;
-        initial_claim = 0;
-        number_requested = 0;
-        number_released = 0;
+    const char* data;
+    size_t size, pos;
+    int line, line_start, token_line, token_column;
+    bool found;
+    string error;
+
+    InputFile() {
+        data = NULL;
+        size = 0;
+        pos = 0;
+        line = 1;
+        line_start = 0;
+        token_line = 1;
+        token_column = 1;
+        found = false;
+    }
+
+    ~InputFile() {
+        if (data != NULL) {
+            munmap((void*) data, size);
+        }
+    }
+
+    bool open(const string& file_name) {
+        // Maps the file into memory. Returns false if it cannot be read or is empty.
+        int fd = ::open(file_name.c_str(), O_RDONLY);
+        found = fd != -1;
+        if (!found) {
+            error = "file not found";
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == -1 or st.st_size == 0) {
+            close(fd);
+            error = "empty file";
+            return false;
+        }
+
+        void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            error = "cannot map file";
+            return false;
+        }
+        madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+
+        data = (const char*) mapped;
+        size = st.st_size;
+        rewind();
+        return true;
+    }
+
+    void rewind() {
+        // Goes back to the first token of the file.
+        pos = 0;
+        line = 1;
+        line_start = 0;
+    }
+
+    bool at_end() {
+        // Skips white space. Returns true if there are no tokens left.
+        skip_space();
+        return pos == size;
+    }
+
+    bool next_int(int& value) {
+        // Parses the next token as an integer.
+        if (!start_token()) return fail("expected an integer, found end of file");
+
+        bool negative = data[pos] == '-';
+        if (negative or data[pos] == '+') pos++;
+        if (pos == size or !isdigit(data[pos])) return fail("expected an integer");
+
+        long long result = 0;
+        while (pos < size and isdigit(data[pos])) {
+            result = result * 10 + (data[pos] - '0');
+            if (result > INT_MAX) return fail("integer out of range");
+            pos++;
+        }
+        if (pos < size and !isspace(data[pos])) return fail("expected an integer");
+
+        value = int(negative ? -result : result);
+        return true;
+    }
+
+    bool next_opcode(Opcode& op) {
+        // Parses the next token as an instruction word.
+        if (!start_token()) return fail("expected an instruction, found end of file");
+
+        size_t begin = pos;
+        while (pos < size and !isspace(data[pos])) {
+            pos++;
+        }
+        op = get_opcode(data + begin, pos - begin);
+        if (op == OP_INVALID) return fail("unknown instruction");
+        return true;
+    }
+
+    bool fail(const string& message) {
+        // Records an error at the position of the last token. Always returns false.
+        ostringstream out;
+        out << "line " << token_line << ", column " << token_column << ": " << message;
+        error = out.str();
+        return false;
+    }
+
+private:
+    void skip_space() {
+        while (pos < size and isspace(data[pos])) {
+            if (data[pos] == '\n') {
+                line++;
+                line_start = pos + 1;
+            }
+            pos++;
+        }
+    }
+
+    bool start_token() {
+        skip_space();
+        token_line = line;
+        token_column = pos - line_start + 1;
+        return pos < size;
+    }
+};
+
+
+class InstructionList {
+    /*
+     * The instructions read by the ResManager, stored as a structure of arrays.
+     * The last number of an instruction is kept in a single amount field, which
+     * holds the initial claim, the number requested or the number released
+     * depending on the opcode. The task an instruction belongs to is implicit:
+     * instructions are stored grouped by task (see Program::task_start).
+     *
+     * The arrays are read through plain pointers, to the list's own storage or,
+     * for a compiled input, straight into the mapped file (see view). Then the
+     * instructions are never copied, and only those runs reach are read from disk.
+     */
+public:
+    const Opcode* opcode;
+    const unsigned short* resource_type;
+    const int* delay;
+    const int* amount;
+
+    InstructionList() {
+        count = 0;
+        viewing = false;
+        point();
+    }
+
+    InstructionList(const InstructionList& other) {
+        *this = other;
+    }
 
-        // Depending on the instruction type, set the corresponding value to the last element passed to the constructor.
-        if (type == "initiate") {
-            initial_claim = num_res;
-        } else if (type == "request") {
-            number_requested = num_res;
-        } else if (type == "release") {
-            number_released = num_res;
+    InstructionList& operator=(const InstructionList& other) {
+        opcode_store = other.opcode_store;
+        resource_type_store = other.resource_type_store;
+        delay_store = other.delay_store;
+        amount_store = other.amount_store;
+        count = other.count;
+        viewing = other.viewing;
+        if (viewing) {
+            opcode = other.opcode;
+            resource_type = other.resource_type;
+            delay = other.delay;
+            amount = other.amount;
+        } else {
+            point();
         }
+        return *this;
+    }
+
+    void view(const Opcode* ops, const unsigned short* res, const int* dels, const int* amounts, int size) {
+        // Reads the instructions from arrays owned by someone else, which must outlive the list.
+        clear();
+        opcode = ops;
+        resource_type = res;
+        delay = dels;
+        amount = amounts;
+        count = size;
+        viewing = true;
+    }
+
+    void resize(int size) {
+        opcode_store.resize(size);
+        resource_type_store.resize(size);
+        delay_store.resize(size);
+        amount_store.resize(size);
+        count = size;
+        point();
+    }
+
+    void add(Opcode op, int del, int res, int num_res) {
+        opcode_store.emplace_back(op);
+        delay_store.emplace_back(del);
+        resource_type_store.emplace_back((unsigned short) res);
+        amount_store.emplace_back(num_res);
+        count++;
+        point();
+    }
+
+    void set(int ind, Opcode op, int del, int res, int num_res) {
+        opcode_store[ind] = op;
+        delay_store[ind] = del;
+        resource_type_store[ind] = (unsigned short) res;
+        amount_store[ind] = num_res;
+    }
+
+    int size() const {
+        return count;
+    }
+
+    void clear() {
+        opcode_store.clear();
+        resource_type_store.clear();
+        delay_store.clear();
+        amount_store.clear();
+        count = 0;
+        viewing = false;
+        point();
+    }
+
+private:
+    vector<Opcode> opcode_store;
+    vector<unsigned short> resource_type_store;
+    vector<int> delay_store;
+    vector<int> amount_store;
+    int count;
+    bool viewing;
+
+    void point() {
+        opcode = opcode_store.data();
+        resource_type = resource_type_store.data();
+        delay = delay_store.data();
+        amount = amount_store.data();
     }
 };
 
@@ -83,58 +441,40 @@ class Task {
      * tasks in the input.
      */
 public:
-    int time_taken, waiting_time, curr_instr, curr_wait;
+    // Cycle counts are 64-bit, so that runs over billions of cycles add up.
+    long long time_taken, waiting_time, curr_wait;
+    int curr_instr, delay_spent;
     bool complete, aborted;
-    vector<int> resource_types;
-    vector<int> initial_claims;
-    vector<int> resources_held;
 
     Task() {
         time_taken = 0;
         waiting_time = 0;
         curr_instr = 0;
         curr_wait = 0;
+        delay_spent = 0;
         complete = false;
         aborted = false;
     }
 
-    void initiate(int res_type, int init_claim) {
+    void initiate() {
         // Code to be executed on an 'initiate' type of instruction.
-        resource_types.emplace_back(res_type);
-        initial_claims.emplace_back(init_claim);
-        resources_held.emplace_back(0);
         curr_instr++;
+        delay_spent = 0;
         time_taken++;
     }
 
-    void granted(int res_type, int num_granted) {
+    void granted() {
         // Code to be executed when a 'request' type of instruction is approved.
-        int ind = 0;
-        for (int rt: resource_types) {
-            if (rt == res_type) {
-                break;
-            }
-            ind++;
-        }
-
-        resources_held[ind] += num_granted;
         curr_instr++;
+        delay_spent = 0;
         time_taken++;
         curr_wait = 0;
     }
 
-    void release(int res_type, int num_to_release) {
+    void release() {
         // Code to be executed on a 'release' type of instruction.
-        int ind = 0;
-        for (int rt: resource_types) {
-            if (rt == res_type) {
-                break;
-            }
-            ind++;
-        }
-
-        resources_held[ind] -= num_to_release;
         curr_instr++;
+        delay_spent = 0;
         time_taken++;
     }
 
@@ -142,13 +482,14 @@ public:
         // Code to be executed on a 'terminate' type of instruction.
         complete = true;
         curr_instr++;
+        delay_spent = 0;
     }
 
-    void wait() {
+    void wait(int cycles = 1) {
         // Code to be executed when a 'request' type of instruction is valid but not approved.
-        time_taken++;
-        waiting_time++;
-        curr_wait++;
+        time_taken += cycles;
+        waiting_time += cycles;
+        curr_wait += cycles;
     }
 
     void abort() {
@@ -158,657 +499,4408 @@ public:
         waiting_time = -1;
     }
 
-    void delay() {
+    void delay(int cycles = 1) {
         // Code to be executed if a given instruction that references this task is delayed.
-        time_taken++;
+        time_taken += cycles;
+        delay_spent += cycles;
+    }
+
+    long long work_done() const {
+        // The cycles spent running or delayed rather than waiting, lost if the task is aborted.
+        return time_taken - waiting_time;
     }
 };
 
 
-class ResManager {
+struct TaskResult {
+    /*
+     * What a run reports for a task: the cycles it took and spent waiting, unless
+     * it was aborted.
+     */
+    long long time_taken, waiting_time;
+    bool aborted;
+};
+
+
+class WaitQueue {
     /*
-     * A resource manager that executes both FIFO and
-     * Banker's algorithm.
+     * The tasks blocked on a request, in the order in which their requests are
+     * considered every cycle: longest wait first and, among tasks that started
+     * waiting on the same cycle, by task number. New requests that cannot be
+     * granted are appended at the back, so the order never needs sorting.
+     * Stored as a doubly linked list over task indices.
      */
 public:
-    vector<string> original_input;
-    vector<Task> task_list;
-    vector<int> total_res_list;
-    vector<int> current_res_list;
-    vector<Instruction> instr_list;
-    bool deadlock;
-    int cycle;
+    vector<int> next, prev;
+    vector<bool> queued;
+    int head, tail, size;
 
-    explicit ResManager(vector<string> input) {
-        // Store the original input.
-        original_input = input;
-        deadlock = false;
+    void reset(int num_tasks) {
+        next.assign(num_tasks, -1);
+        prev.assign(num_tasks, -1);
+        queued.assign(num_tasks, false);
+        head = -1;
+        tail = -1;
+        size = 0;
+    }
 
-        // Create all task instances.
-        int num_tasks = stoi(input[0]);
-        for (int i = 0; i < num_tasks; i++) {
-            task_list.emplace_back(Task());
-        }
+    void grow(int num_tasks) {
+        // Makes room for more tasks, keeping the queue as it is.
+        next.resize(num_tasks, -1);
+        prev.resize(num_tasks, -1);
+        queued.resize(num_tasks, false);
+    }
 
-        // Store resources and resource amounts in a list.
-        int res_types = stoi(input[1]);
-        for (int i = 0; i < res_types; i++) {
-            total_res_list.emplace_back(stoi(input[2 + i]));
+    void push_back(int task_ind) {
+        prev[task_ind] = tail;
+        next[task_ind] = -1;
+        if (tail == -1) {
+            head = task_ind;
+        } else {
+            next[tail] = task_ind;
         }
-        current_res_list = total_res_list;
+        tail = task_ind;
+        queued[task_ind] = true;
+        size++;
+    }
 
-        // Create all instruction instances.
-        for (int i = 2 + res_types; i < input.size(); i = i + 5) {
-            instr_list.emplace_back(Instruction(input[i], stoi(input[i + 1]), stoi(input[i + 2]),
-                                                stoi(input[i + 3]), stoi(input[i + 4])));
+    void remove(int task_ind) {
+        if (!queued[task_ind]) return;
+        if (prev[task_ind] == -1) {
+            head = next[task_ind];
+        } else {
+            next[prev[task_ind]] = next[task_ind];
         }
-
-        cycle = 1;
+        if (next[task_ind] == -1) {
+            tail = prev[task_ind];
+        } else {
+            prev[next[task_ind]] = prev[task_ind];
+        }
+        queued[task_ind] = false;
+        size--;
     }
+};
 
-    void execute() {
-        // Resolve all tasks using FIFO.
-        execute_fifo();
-        vector<int> results_fifo = gather_results();
-
-        // Restore all original values as in the input.
-        reset();
-
-        // Resolve all tasks using Banker's.
-        execute_bankers();
-        vector<int> results_bankers = gather_results();
 
-        // Display results on screen.
-        print(results_fifo, results_bankers);
-    }
+const long long SLACK_INF = LLONG_MAX / 4;
 
-private:
-    void execute_fifo() {
-        // Initiate all the tasks in round zero.
-        for (Instruction ins: instr_list) {
-            if (ins.type == "initiate") {
-                task_list[ins.task_number - 1].initiate(ins.resource_type, ins.initial_claim);
-            }
-        }
 
-        // Loop through all the instructions until all resources have been terminated or aborted.
-        bool finished = false;
-        while (!finished) {
-            // If not all tasks are waiting, it might not be a deadlock.
-            deadlock = true;
-            for (Task t: task_list) {
-                if (t.complete or t.aborted) {
-                    continue;
-                } else if (t.curr_wait <= 0) {
-                    deadlock = false;
-                }
-            }
+class SlackTree {
+    /*
+     * A segment tree over the positions of a safe sequence that holds, for one
+     * resource type, the slack of every task: the units that would be left over
+     * if the task had to satisfy its remaining claim when its turn comes. Both
+     * adding a value to a range of positions and finding the minimum of a range
+     * take O(log n). Positions of tasks that left the sequence hold SLACK_INF.
+     */
+public:
+    int size;
+    vector<long long> tree, lazy;
 
-            // Will not do anything unless deadlock is set to true.
-            if (deadlock) {
-                cout << "Deadlock found during cycles " << cycle - 1 << "-" << cycle << " of FIFO" << endl;
-            }
-            handle_deadlock();
+    void build(const vector<long long>& values) {
+        size = values.size();
+        tree.assign(4 * max(size, 1), SLACK_INF);
+        lazy.assign(4 * max(size, 1), 0);
+        if (size > 0) build(1, 0, size, values);
+    }
 
-            int t_num = 1;
+    void add(int lo, int hi, long long value) {
+        // Adds value to the slack of the positions in [lo, hi).
+        if (lo < hi) add(1, 0, size, lo, hi, value);
+    }
 
-            // Lists needed to execute 'release's and 'require's.
-            vector<int> released_types;
-            vector<int> released_amounts;
-            vector<int> reqs;
+    long long min_of(int lo, int hi) {
+        // Returns the minimum slack of the positions in [lo, hi).
+        if (lo >= hi) return SLACK_INF;
+        return min_of(1, 0, size, lo, hi);
+    }
 
-            // Loops through all the tasks identifying the next instruction to be executed for each task.
-            for (Task t: task_list) {
-                if (t.aborted or t.complete) {
-                    t_num++;
-                    continue;
-                }
+    void remove(int pos) {
+        // Takes a position out of consideration for future queries.
+        remove(1, 0, size, pos);
+    }
 
-                int i_num = 0;
-                int ins_ind = 0;
-                for (Instruction ins: instr_list) {
-                    if (ins.task_number == t_num) {
-                        if (i_num == t.curr_instr) {
-                            break;
-                        }
-                        i_num++;
-                    }
-                    ins_ind++;
-                }
+private:
+    void build(int node, int lo, int hi, const vector<long long>& values) {
+        if (hi - lo == 1) {
+            tree[node] = values[lo];
+            return;
+        }
+        int mid = (lo + hi) / 2;
+        build(2 * node, lo, mid, values);
+        build(2 * node + 1, mid, hi, values);
+        tree[node] = min(tree[2 * node], tree[2 * node + 1]);
+    }
 
-                // Only execute instructions whose delay is equal to zero.
-                if (instr_list[ins_ind].delay == 0) {
-                    // If the next instruction is a request, add it to the list of requests.
-                    if (instr_list[ins_ind].type == "request") {
-                        reqs.emplace_back(ins_ind);
+    void push(int node) {
+        for (int child = 2 * node; child <= 2 * node + 1; child++) {
+            tree[child] += lazy[node];
+            lazy[child] += lazy[node];
+        }
+        lazy[node] = 0;
+    }
 
-                    // If the next instruction is a release, release from the task and add the released
-                    // resources to the lists (types and amounts).
-                    } else if (instr_list[ins_ind].type == "release") {
-                        task_list[t_num - 1].release(instr_list[ins_ind].resource_type,
-                                                     instr_list[ins_ind].number_released);
-                        released_types.emplace_back(instr_list[ins_ind].resource_type);
-                        released_amounts.emplace_back(instr_list[ins_ind].number_released);
+    void add(int node, int lo, int hi, int qlo, int qhi, long long value) {
+        if (qhi <= lo or hi <= qlo) return;
+        if (qlo <= lo and hi <= qhi) {
+            tree[node] += value;
+            lazy[node] += value;
+            return;
+        }
+        push(node);
+        int mid = (lo + hi) / 2;
+        add(2 * node, lo, mid, qlo, qhi, value);
+        add(2 * node + 1, mid, hi, qlo, qhi, value);
+        tree[node] = min(tree[2 * node], tree[2 * node + 1]);
+    }
 
-                    // If the next instruction is a terminate, terminate the task.
-                    } else if (instr_list[ins_ind].type == "terminate") {
-                        task_list[t_num - 1].terminate();
-                    }
+    long long min_of(int node, int lo, int hi, int qlo, int qhi) {
+        if (qhi <= lo or hi <= qlo) return SLACK_INF;
+        if (qlo <= lo and hi <= qhi) return tree[node];
+        push(node);
+        int mid = (lo + hi) / 2;
+        return min(min_of(2 * node, lo, mid, qlo, qhi), min_of(2 * node + 1, mid, hi, qlo, qhi));
+    }
 
-                // If delay is not zero, delay the task.
-                } else {
-                    instr_list[ins_ind].delay--;
-                    task_list[t_num - 1].delay();
-                }
+    void remove(int node, int lo, int hi, int pos) {
+        if (hi - lo == 1) {
+            tree[node] = SLACK_INF;
+            lazy[node] = 0;
+            return;
+        }
+        push(node);
+        int mid = (lo + hi) / 2;
+        if (pos < mid) {
+            remove(2 * node, lo, mid, pos);
+        } else {
+            remove(2 * node + 1, mid, hi, pos);
+        }
+        tree[node] = min(tree[2 * node], tree[2 * node + 1]);
+    }
+};
 
-                t_num++;
-            }
 
-            // Create a list of sorted indices for the 'require' instructions this round.
-            vector<int> sorted_reqs;
-            vector<int> used_indices;
-            for (int i = 0; i < reqs.size(); i++) {
-                int max_prio = -1;
-                int max_ind = 0;
-                for (int j = 0; j < reqs.size(); j++) {
-                    Task t = task_list[instr_list[reqs[j]].task_number - 1];
-                    if (t.curr_wait > max_prio and
-                        find(used_indices.begin(), used_indices.end(), j) == used_indices.end()) {
-                        max_prio = t.curr_wait;
-                        max_ind = j;
-                    }
-                }
-                sorted_reqs.emplace_back(reqs[max_ind]);
-                used_indices.emplace_back(max_ind);
-            }
+// Compiled programs start with this, then the version of their layout (see Program::write_compiled).
+const char PROGRAM_MAGIC[8] = {'R', 'M', 'P', 'R', 'O', 'G', 'R', 'M'};
+const int PROGRAM_VERSION = 1;
 
-            // Go through the tasks that have requested this cycle and execute them when possible,
-            // in order of priority.
-            for (int ind: sorted_reqs) {
-                bool safe = fifo_check(ind);
-                if (safe) {
-                    task_list[instr_list[ind].task_number - 1].granted(instr_list[ind].resource_type,
-                                                                       instr_list[ind].number_requested);
-                    current_res_list[instr_list[ind].resource_type - 1] -= instr_list[ind].number_requested;
-                } else {
-                    task_list[instr_list[ind].task_number - 1].wait();
-                }
-            }
 
-            // Add the released resources back to the manager at the end of the cycle.
-            for (int i = 0; i < released_types.size(); i++) {
-                current_res_list[released_types[i] - 1] += released_amounts[i];
-            }
+class Program {
+    /*
+     * The parsed input: the resources and the instructions of every task. It
+     * is never modified by a run, so any number of runs can share it. A compiled
+     * input is not copied: its instructions are read from the input file, which
+     * must stay open while the program is in use.
+     */
+public:
+    int num_tasks;
+    vector<int> total_res_list;
+    InstructionList instr_list;
+    vector<int> task_start;
+    vector<int> initiate_list;
 
-            // If all tasks are finished or aborted, end.
-            finished = true;
-            for (Task t: task_list) {
-                if (t.aborted) {
-                    continue;
-                }
-                if (!t.complete) {
-                    finished = false;
-                }
-            }
-            cycle++;
-        }
+    Program() {
+        num_tasks = 0;
     }
 
-    void handle_deadlock() {
+    bool load(InputFile& input) {
         /*
-         * Loops through the tasks when deadlocked and aborts them
-         * when necessary, in order of appearance.
+         * Reads the tasks, resources and instructions described by the input.
+         * Instructions are stored grouped by task, in order of appearance, so that
+         * each task's program is the slice of instr_list starting at the task's
+         * task_start. Returns false if the input is malformed (see input.error).
+         * Compiled inputs are recognized and read as such.
          */
-        int to_abort = 0;
-        while (deadlock) {
-            // Verify deadlock.
-            int t_num = 1;
-            for (Task t: task_list) {
-                // Ignore tasks that have already been aborted or completed.
-                if (t.aborted or t.complete) {
-                    t_num++;
-                    continue;
-                }
-
-                int i_num = 0;
-                int ins_ind = 0;
-                for (Instruction ins: instr_list) {
-                    if (ins.task_number == t_num) {
-                        if (i_num == t.curr_instr) {
-                            break;
-                        }
-                        i_num++;
-                    }
-                    ins_ind++;
-                }
+        input.rewind();
+        if (input.size >= sizeof(PROGRAM_MAGIC) and memcmp(input.data, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC)) == 0) {
+            return load_compiled(input);
+        }
 
-                // Check if the instruction's request can be completed. If so, not a deadlock anymore.
-                if (instr_list[ins_ind].number_requested <= current_res_list[instr_list[ins_ind].resource_type - 1]) {
-                    deadlock = false;
-                    break;
-                }
+        // Read the number of tasks.
+        if (!input.next_int(num_tasks)) return false;
+        if (num_tasks < 0) return input.fail("negative number of tasks");
 
-                t_num++;
-            }
+        // Store resources and resource amounts in a list.
+        int res_types;
+        if (!input.next_int(res_types)) return false;
+        if (res_types < 0 or res_types > USHRT_MAX) return input.fail("number of resource types out of range");
+        total_res_list.resize(res_types);
+        for (int i = 0; i < res_types; i++) {
+            if (!input.next_int(total_res_list[i])) return false;
+        }
 
-            // End loop if not a deadlock.
-            if (!deadlock) {
-                break;
-            }
+        // Read all instructions in order of appearance, counting the instructions of every task.
+        InstructionList read;
+        vector<int> task_numbers;
+        vector<int> fill(num_tasks + 1, 0);
+        while (!input.at_end()) {
+            Opcode op;
+            int task, del, res, num_res;
+            if (!input.next_opcode(op)) return false;
+            if (!input.next_int(task)) return false;
+            if (task < 1 or task > num_tasks) return input.fail("task number out of range");
+            if (!input.next_int(del) or !input.next_int(res)) return false;
+            if (!resource_in_range(op, res, res_types)) return input.fail("resource type out of range");
+            if (!input.next_int(num_res)) return false;
 
-            // Cannot abort tasks that are completed or already aborted.
-            if (task_list[to_abort].complete or task_list[to_abort].aborted) {
-                to_abort++;
+            read.add(op, del, res, num_res);
+            if (op == OP_ALSO and !continues_request(read, read.size() - 1,
+                                                      task_numbers.empty() or task_numbers.back() != task)) {
+                return input.fail("an also must follow its task's request or also, with no delay and another resource type");
             }
+            task_numbers.emplace_back(task);
+            fill[task]++;
+        }
 
-            cout << "    Task " << to_abort + 1 << " aborted" << endl;
+        // Find where each task's program starts.
+        task_start.assign(num_tasks + 1, 0);
+        for (int i = 0; i < num_tasks; i++) {
+            task_start[i + 1] = task_start[i] + fill[i + 1];
+            fill[i + 1] = task_start[i];
+        }
 
-            // Abort next task.
-            task_list[to_abort].abort();
-            for (int i = 0; i < task_list[to_abort].resource_types.size(); i++) {
-                current_res_list[task_list[to_abort].resource_types[i] - 1] += task_list[to_abort].resources_held[i];
+        // Move all instructions to their task's slice.
+        instr_list.resize(read.size());
+        for (int i = 0; i < read.size(); i++) {
+            int ind = fill[task_numbers[i]]++;
+            instr_list.set(ind, read.opcode[i], read.delay[i], read.resource_type[i], read.amount[i]);
+            if (read.opcode[i] == OP_INITIATE) {
+                initiate_list.emplace_back(ind);
             }
-
-            to_abort++;
         }
+
+        return true;
     }
 
-    bool fifo_check(int ind) {
+    void write_compiled(ostream& out) const {
         /*
-         * Check if the 'require' instruction can be satisfied or not.
+         * Writes the program in the layout it has in memory, to be read back by
+         * load_compiled without parsing: the magic and version, the numbers of
+         * tasks, resource types, instructions and initiates, then the arrays as
+         * native integers. Arrays of wider elements come first, so that each one
+         * is aligned within the mapped file.
          */
-        int task_ind = instr_list[ind].task_number - 1;
-        int res_type = instr_list[ind].resource_type;
-
-        if (current_res_list[res_type - 1] < instr_list[ind].number_requested) {
-            return false;
-        }
+        int header[] = {PROGRAM_VERSION, num_tasks, int(total_res_list.size()), instr_list.size(),
+                        int(initiate_list.size())};
+        out.write(PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC));
+        out.write((const char*) header, sizeof(header));
+        write_array(out, total_res_list);
+        write_array(out, task_start);
+        write_array(out, initiate_list);
+        write_array(out, instr_list.delay, instr_list.size());
+        write_array(out, instr_list.amount, instr_list.size());
+        write_array(out, instr_list.resource_type, instr_list.size());
+        write_array(out, instr_list.opcode, instr_list.size());
+    }
 
-        return true;
+    int task_of(int ind) const {
+        /*
+         * Returns the index of the task an instruction belongs to.
+         * Only used outside of the main loops (instructions store no task number).
+         */
+        return int(upper_bound(task_start.begin(), task_start.end(), ind) - task_start.begin()) - 1;
     }
 
-    void execute_bankers() {
-        // Initiate all the tasks in round zero.
-        for (Instruction ins: instr_list) {
-            if (ins.type == "initiate") {
-                // Check whether the claim is valid.
-                if (ins.initial_claim <= total_res_list[ins.resource_type - 1]) {
-                    task_list[ins.task_number - 1].initiate(ins.resource_type, ins.initial_claim);
+private:
+    template <class T>
+    static void write_array(ostream& out, const vector<T>& values) {
+        write_array(out, values.data(), values.size());
+    }
+
+    template <class T>
+    static void write_array(ostream& out, const T* values, size_t count) {
+        out.write((const char*) values, count * sizeof(T));
+    }
+
+    static bool continues_request(const InstructionList& list, int ind, bool first_of_task) {
+        /*
+         * Whether the also at ind is a part of the request before it: it follows the
+         * request or another of its alsos within the same task, waits no delay of
+         * its own and names a resource type no other part names.
+         */
+        if (first_of_task or (list.opcode[ind - 1] != OP_REQUEST and list.opcode[ind - 1] != OP_ALSO) or
+            list.delay[ind] != 0 or list.resource_type[ind] == 0) {
+            return false;
+        }
+        for (int i = ind - 1; ; i--) {
+            if (list.resource_type[i] == list.resource_type[ind]) {
+                return false;
+            } else if (list.opcode[i] == OP_REQUEST) {
+                return true;
+            }
+        }
+    }
+
+    template <class T>
+    static const char* read_array(const char* pos, int count, vector<T>& values) {
+        // Copies count elements of the mapped file, returning the position after them.
+        const T* first = (const T*) pos;
+        values.assign(first, first + count);
+        return pos + count * sizeof(T);
+    }
+
+    bool load_compiled(InputFile& input) {
+        /*
+         * Reads a program written by write_compiled, checking everything a text
+         * input would be checked for, so that a run can trust it just the same.
+         * Only the resources, task slices and initiates are copied; the instructions
+         * are streamed from the mapped file as every task reaches them, so memory
+         * grows with the number of tasks rather than with the instructions. The
+         * checks still read the whole file once, up front: a run has no way to
+         * stop on a malformed instruction it only finds halfway through. The
+         * pages they read are given back before any run starts.
+         */
+        int header[5];
+        if (input.size < sizeof(PROGRAM_MAGIC) + sizeof(header)) {
+            input.error = "compiled file cut short";
+            return false;
+        }
+        memcpy(header, input.data + sizeof(PROGRAM_MAGIC), sizeof(header));
+        if (header[0] != PROGRAM_VERSION) {
+            input.error = "compiled file of another version, compile it again";
+            return false;
+        }
+        num_tasks = header[1];
+        int res_types = header[2], num_instr = header[3], num_initiates = header[4];
+        if (num_tasks < 0 or res_types < 0 or res_types > USHRT_MAX or num_instr < 0 or num_initiates < 0 or
+            num_initiates > num_instr) {
+            input.error = "compiled file with a malformed header";
+            return false;
+        }
+        size_t ints = size_t(res_types) + num_tasks + 1 + num_initiates + 2 * size_t(num_instr);
+        size_t expected = sizeof(PROGRAM_MAGIC) + sizeof(header) + ints * sizeof(int) +
+                          num_instr * (sizeof(unsigned short) + sizeof(Opcode));
+        if (input.size != expected) {
+            input.error = "compiled file of the wrong size";
+            return false;
+        }
+
+        // The instructions stay in the mapped file, where the delays come first.
+        const char* pos = input.data + sizeof(PROGRAM_MAGIC) + sizeof(header);
+        pos = read_array(pos, res_types, total_res_list);
+        pos = read_array(pos, num_tasks + 1, task_start);
+        pos = read_array(pos, num_initiates, initiate_list);
+        const int* delays = (const int*) pos;
+        const int* amounts = delays + num_instr;
+        const unsigned short* res = (const unsigned short*) (amounts + num_instr);
+        instr_list.view((const Opcode*) (res + num_instr), res, delays, amounts, num_instr);
+
+        // Every task's slice follows the previous one, and every instruction is one a text input could hold.
+        bool valid = task_start[0] == 0 and task_start[num_tasks] == num_instr;
+        for (int t = 0; t < num_tasks; t++) {
+            valid = valid and task_start[t] <= task_start[t + 1];
+        }
+        int invalid = 0, initiates = 0, alsos = 0;
+        for (int i = 0; i < num_instr; i++) {
+            invalid |= int(instr_list.opcode[i] >= OP_INVALID or
+                           !resource_in_range(instr_list.opcode[i], instr_list.resource_type[i], res_types));
+            initiates += int(instr_list.opcode[i] == OP_INITIATE);
+            alsos += int(instr_list.opcode[i] == OP_ALSO);
+        }
+        valid = valid and invalid == 0;
+        for (int t = 0; valid and alsos > 0 and t < num_tasks; t++) {
+            for (int i = task_start[t]; valid and i < task_start[t + 1]; i++) {
+                valid = instr_list.opcode[i] != OP_ALSO or continues_request(instr_list, i, i == task_start[t]);
+            }
+        }
+
+        // The initiates are listed once each, in order of appearance in the text input.
+        vector<bool> listed(num_instr, false);
+        valid = valid and initiates == num_initiates;
+        for (int ind: initiate_list) {
+            if (!valid or ind < 0 or ind >= num_instr or instr_list.opcode[ind] != OP_INITIATE or listed[ind]) {
+                valid = false;
+                break;
+            }
+            listed[ind] = true;
+        }
+        if (!valid) {
+            input.error = "compiled file with malformed instructions";
+            return false;
+        }
+
+        // Give back the pages read by the checks. Each task reads its own slice from
+        // here on, so the kernel is not told to expect reads in file order.
+        madvise((void*) input.data, input.size, MADV_DONTNEED);
+        madvise((void*) input.data, input.size, MADV_NORMAL);
+        return true;
+    }
+};
+
+
+class RunState {
+    /*
+     * Everything that changes during a run: the cursor, delay counter, held
+     * resources and counters of every task, the available units and the
+     * current cycle. Copying the initial state is all it takes to start
+     * another run over the same program.
+     */
+public:
+    vector<Task> task_list;
+    vector<int> current_res_list;
+
+    // Claimed, held and still needed units of every task, as row-major
+    // num_tasks x num_res matrices indexed by task and resource type - 1.
+    vector<int> claims, held, need;
+    int num_res;
+    long long cycle;
+
+    RunState() {
+        num_res = 0;
+        cycle = 1;
+    }
+
+    explicit RunState(const Program& program) {
+        task_list.assign(program.num_tasks, Task());
+        current_res_list = program.total_res_list;
+        num_res = program.total_res_list.size();
+        claims.assign(program.num_tasks * num_res, 0);
+        held.assign(program.num_tasks * num_res, 0);
+        need.assign(program.num_tasks * num_res, 0);
+        cycle = 1;
+    }
+
+    void initiate(int task_ind, int res_type, int claim) {
+        // Adds to the claim of a task on a resource type.
+        int cell = task_ind * num_res + res_type - 1;
+        task_list[task_ind].initiate();
+        claims[cell] += claim;
+        need[cell] += claim;
+    }
+
+    void granted(int task_ind, int res_type, int num_granted) {
+        // Gives units of a resource type to a task.
+        int cell = task_ind * num_res + res_type - 1;
+        task_list[task_ind].granted();
+        held[cell] += num_granted;
+        need[cell] -= num_granted;
+    }
+
+    void granted_also(int task_ind, int res_type, int num_granted) {
+        // Gives the units of another part of a request being granted, which takes no cycle of its own.
+        int cell = task_ind * num_res + res_type - 1;
+        task_list[task_ind].curr_instr++;
+        held[cell] += num_granted;
+        need[cell] -= num_granted;
+    }
+
+    void release(int task_ind, int res_type, int num_to_release) {
+        // Takes units of a resource type back from a task.
+        int cell = task_ind * num_res + res_type - 1;
+        task_list[task_ind].release();
+        held[cell] -= num_to_release;
+        need[cell] += num_to_release;
+    }
+
+    int take_held(int task_ind, int res_type) {
+        // Takes every unit of a resource type away from an aborted task, returning how many.
+        int cell = task_ind * num_res + res_type - 1;
+        int taken = held[cell];
+        held[cell] = 0;
+        need[cell] = claims[cell];
+        return taken;
+    }
+
+    int held_of(int task_ind, int res_type) const {
+        // Number of units of a resource type currently held by a task.
+        return held[task_ind * num_res + res_type - 1];
+    }
+
+    int need_of(int task_ind, int res_type) const {
+        // Number of units of a resource type a task may still request according to its claims.
+        return need[task_ind * num_res + res_type - 1];
+    }
+};
+
+
+enum Policy {
+    /*
+     * The resource managing algorithms a ResManager can execute. Batched is
+     * Banker's deciding on all the requests of a cycle at once.
+     */
+    POLICY_FIFO,
+    POLICY_BANKERS,
+    POLICY_SRNF,
+    POLICY_BATCHED
+};
+
+// The name of each policy on the command line and in the output, and in traces.
+const char* const POLICY_KEYS[] = {"fifo", "bankers", "srnf", "batched"};
+const char* const POLICY_TRACE_NAMES[] = {"FIFO", "BANKER'S", "SRNF", "BATCHED BANKER'S"};
+
+
+bool parse_policies(const string& list, vector<Policy>& policies) {
+    /*
+     * Reads a comma separated list of policy names, e.g. "fifo,srnf". Returns
+     * false if any name is unknown or the list is empty.
+     */
+    policies.clear();
+    istringstream in(list);
+    string key;
+    while (getline(in, key, ',')) {
+        int p = 0;
+        while (p <= POLICY_BATCHED and key != POLICY_KEYS[p]) {
+            p++;
+        }
+        if (p > POLICY_BATCHED) {
+            return false;
+        }
+        policies.emplace_back(Policy(p));
+    }
+    return !policies.empty();
+}
+
+
+enum VictimPolicy {
+    /*
+     * How the optimistic policies pick the tasks to abort when they deadlock:
+     * in order of appearance (the original behavior), fewest units held first,
+     * most units held of the resource types blocked on first, least work done
+     * first, or the fewest tasks whose units let some blocked request through.
+     */
+    VICTIM_LOWEST,
+    VICTIM_FEWEST_HELD,
+    VICTIM_MOST_FREED,
+    VICTIM_LEAST_PROGRESS,
+    VICTIM_MIN_SET
+};
+
+// The name of each victim policy on the command line.
+const char* const VICTIM_KEYS[] = {"lowest", "fewest-held", "most-freed", "least-progress", "min-set"};
+
+
+bool parse_victim_policy(const string& key, VictimPolicy& victims) {
+    // Reads a victim policy name. Returns false if it is unknown.
+    for (int v = VICTIM_LOWEST; v <= VICTIM_MIN_SET; v++) {
+        if (key == VICTIM_KEYS[v]) {
+            victims = VictimPolicy(v);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+class Checkpoint {
+    /*
+     * A run stopped at the start of a cycle, with everything needed to carry on
+     * from there: the state of every task, the available units, the waiting queue
+     * in order and the messages so far. Copying one is all it takes to fork any
+     * number of runs from it, each of which may be changed first (see apply).
+     *
+     * On disk, a checkpoint is a flat sequence of native integers (64-bit for
+     * cycle counts, 32-bit otherwise), so that reading it back is little more
+     * than a copy. Only the cells of the claimed and held matrices that are not
+     * both zero are stored (most tasks name a few of the resource types), and the
+     * units still needed follow from them.
+     */
+public:
+    Policy policy;
+    RunState state;
+    vector<int> waiting_order;
+    string messages;
+
+    void append_to(string& out) const {
+        // Appends the binary form of the checkpoint.
+        int num_tasks = state.task_list.size();
+        put(out, int(policy));
+        put(out, state.cycle);
+        put(out, num_tasks);
+        put(out, state.num_res);
+        for (const Task& t: state.task_list) {
+            long long counts[] = {t.time_taken, t.waiting_time, t.curr_wait};
+            int fields[] = {t.curr_instr, t.delay_spent, int(t.complete) | int(t.aborted) << 1};
+            out.append((const char*) counts, sizeof(counts));
+            out.append((const char*) fields, sizeof(fields));
+        }
+        put_array(out, state.current_res_list);
+        int num_cells = 0;
+        for (int cell = 0; cell < state.claims.size(); cell++) {
+            num_cells += int(state.claims[cell] != 0 or state.held[cell] != 0);
+        }
+        put(out, num_cells);
+        for (int cell = 0; cell < state.claims.size(); cell++) {
+            if (state.claims[cell] != 0 or state.held[cell] != 0) {
+                int fields[] = {cell, state.claims[cell], state.held[cell]};
+                out.append((const char*) fields, sizeof(fields));
+            }
+        }
+        put(out, int(waiting_order.size()));
+        put_array(out, waiting_order);
+        put(out, int(messages.size()));
+        out += messages;
+    }
+
+    bool read_from(const char*& pos, const char* end, const Program& program) {
+        /*
+         * Reads the binary form of a checkpoint of a run over the given program,
+         * moving pos past it. Returns false if it is cut short or does not
+         * describe a state such a run can be in.
+         */
+        int pol, num_tasks, num_res, num_cells, num_waiting, num_chars;
+        if (!get(pos, end, pol) or !get(pos, end, state.cycle) or !get(pos, end, num_tasks) or !get(pos, end, num_res)) {
+            return false;
+        }
+        if (pol < POLICY_FIFO or pol > POLICY_BATCHED or state.cycle < 1 or num_tasks != program.num_tasks or
+            num_res != program.total_res_list.size()) {
+            return false;
+        }
+        policy = Policy(pol);
+        state.num_res = num_res;
+
+        state.task_list.assign(num_tasks, Task());
+        for (Task& t: state.task_list) {
+            long long counts[3];
+            int fields[3];
+            if (!get_array(pos, end, counts, 3) or !get_array(pos, end, fields, 3)) {
+                return false;
+            }
+            t.time_taken = counts[0];
+            t.waiting_time = counts[1];
+            t.curr_wait = counts[2];
+            t.curr_instr = fields[0];
+            t.delay_spent = fields[1];
+            t.complete = fields[2] & 1;
+            t.aborted = fields[2] & 2;
+        }
+
+        state.current_res_list.resize(num_res);
+        state.claims.assign(num_tasks * num_res, 0);
+        state.held.assign(num_tasks * num_res, 0);
+        if (!get_array(pos, end, state.current_res_list.data(), num_res) or !get(pos, end, num_cells) or
+            num_cells < 0 or num_cells > num_tasks * num_res) {
+            return false;
+        }
+        for (int k = 0; k < num_cells; k++) {
+            int fields[3];
+            if (!get_array(pos, end, fields, 3) or fields[0] < 0 or fields[0] >= num_tasks * num_res) {
+                return false;
+            }
+            state.claims[fields[0]] = fields[1];
+            state.held[fields[0]] = fields[2];
+        }
+        if (!get(pos, end, num_waiting) or num_waiting < 0 or num_waiting > num_tasks) {
+            return false;
+        }
+        waiting_order.resize(num_waiting);
+        if (!get_array(pos, end, waiting_order.data(), num_waiting) or !get(pos, end, num_chars) or
+            num_chars < 0 or num_chars > end - pos) {
+            return false;
+        }
+        messages.assign(pos, num_chars);
+        pos += num_chars;
+
+        state.need.resize(num_tasks * num_res);
+        for (int cell = 0; cell < num_tasks * num_res; cell++) {
+            state.need[cell] = state.claims[cell] - state.held[cell];
+        }
+        return valid(program);
+    }
+
+    bool apply(const string& change, const Program& program) {
+        /*
+         * Makes a what-if change: "delay:T:C" (task T's next instruction waits C
+         * more cycles before it executes) or "units:R:N" (N units of resource
+         * type R are present from now on). Returns false if the change cannot be
+         * read or made: task T must be running and not blocked on a request, the
+         * units held must fit in the N present and, under Banker's, the state
+         * must stay safe.
+         */
+        istringstream in(change);
+        string kind;
+        int target, value;
+        if (!getline(in, kind, ':') or !(in >> target) or in.get() != ':' or !(in >> value) or in.peek() != EOF) {
+            return false;
+        }
+
+        if (kind == "delay") {
+            int task_ind = target - 1;
+            if (task_ind < 0 or task_ind >= state.task_list.size() or value < 0 or !runs(task_ind) or
+                find(waiting_order.begin(), waiting_order.end(), task_ind) != waiting_order.end()) {
+                return false;
+            }
+            // The delay counter counts up to the instruction's delay; it may start below zero.
+            int ind = program.task_start[task_ind] + state.task_list[task_ind].curr_instr;
+            state.task_list[task_ind].delay_spent = program.instr_list.delay[ind] - value;
+            return true;
+        }
+
+        if (kind == "units") {
+            if (target < 1 or target > state.num_res or value < 0) {
+                return false;
+            }
+            // Units released during the last cycle are back by now, so the units not held are all available.
+            int held = 0;
+            for (int t = 0; t < state.task_list.size(); t++) {
+                held += state.held_of(t, target);
+            }
+            if (held > value) {
+                return false;
+            }
+            state.current_res_list[target - 1] = value - held;
+            return (policy != POLICY_BANKERS and policy != POLICY_BATCHED) or safe();
+        }
+
+        return false;
+    }
+
+private:
+    template <class T>
+    static void put(string& out, T value) {
+        out.append((const char*) &value, sizeof(value));
+    }
+
+    static void put_array(string& out, const vector<int>& values) {
+        out.append((const char*) values.data(), values.size() * sizeof(int));
+    }
+
+    template <class T>
+    static bool get(const char*& pos, const char* end, T& value) {
+        return get_array(pos, end, &value, 1);
+    }
+
+    template <class T>
+    static bool get_array(const char*& pos, const char* end, T* values, int count) {
+        if (end - pos < (long long) count * sizeof(T)) {
+            return false;
+        }
+        memcpy(values, pos, count * sizeof(T));
+        pos += count * sizeof(T);
+        return true;
+    }
+
+    bool runs(int task_ind) const {
+        return !state.task_list[task_ind].complete and !state.task_list[task_ind].aborted;
+    }
+
+    bool valid(const Program& program) const {
+        // Every task is at one of its instructions (not within a request), no further into its delay than
+        // that instruction waits, and only tasks blocked on a request wait.
+        for (int t = 0; t < state.task_list.size(); t++) {
+            const Task& task = state.task_list[t];
+            int count = program.task_start[t + 1] - program.task_start[t];
+            int ind = program.task_start[t] + task.curr_instr;
+            if (task.curr_instr < 0 or task.curr_instr > count or task.delay_spent < 0 or
+                (task.curr_instr < count and
+                 (program.instr_list.opcode[ind] == OP_ALSO or task.delay_spent > program.instr_list.delay[ind]))) {
+                return false;
+            }
+        }
+        vector<bool> queued(state.task_list.size(), false);
+        for (int t: waiting_order) {
+            if (t < 0 or t >= state.task_list.size() or queued[t] or !runs(t) or
+                state.task_list[t].curr_instr == program.task_start[t + 1] - program.task_start[t] or
+                program.instr_list.opcode[program.task_start[t] + state.task_list[t].curr_instr] != OP_REQUEST) {
+                return false;
+            }
+            queued[t] = true;
+        }
+        // Every claim is the one the program's initiates made in round zero (under Banker's, a claim
+        // exceeding the units present is not made).
+        bool bankers = policy == POLICY_BANKERS or policy == POLICY_BATCHED;
+        vector<int> claims(state.claims.size(), 0);
+        for (int ind: program.initiate_list) {
+            int res_type = program.instr_list.resource_type[ind];
+            int claim = program.instr_list.amount[ind];
+            if (!bankers or claim <= program.total_res_list[res_type - 1]) {
+                claims[program.task_of(ind) * state.num_res + res_type - 1] += claim;
+            }
+        }
+        if (claims != state.claims) {
+            return false;
+        }
+
+        // No task holds fewer than no units (nor, under Banker's, more than it claimed), and the units
+        // held and available add up to those present: the units released last cycle are back by now.
+        for (int cell = 0; cell < state.held.size(); cell++) {
+            if (state.held[cell] < 0 or (bankers and state.held[cell] > state.claims[cell])) {
+                return false;
+            }
+        }
+        for (int r = 0; r < state.num_res; r++) {
+            long long units = state.current_res_list[r];
+            for (int t = 0; t < state.task_list.size(); t++) {
+                units += state.held_of(t, r + 1);
+            }
+            if (state.current_res_list[r] < 0 or units != program.total_res_list[r]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool safe() const {
+        // Whether every task still running can finish, as Banker's requires of every state.
+        vector<int> live, available = state.current_res_list, sequence;
+        for (int t = 0; t < state.task_list.size(); t++) {
+            if (runs(t)) {
+                live.emplace_back(t);
+            }
+        }
+        vector<bool> done(state.task_list.size(), false);
+        return find_safe_sequence(state.need.data(), state.held.data(), state.num_res, live, available, done, sequence);
+    }
+};
+
+
+// Checkpoint files start with this, then hold the number of tasks, resource types
+// and instructions of the program and the number of checkpoints, one per run.
+const char CHECKPOINT_MAGIC[8] = {'R', 'M', 'C', 'K', 'P', 'T', '0', '2'};
+
+
+bool write_checkpoints(const string& file_name, const Program& program, const vector<Checkpoint>& checkpoints) {
+    /*
+     * Writes the checkpoints of runs over a program to a file.
+     */
+    string out(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    int header[] = {program.num_tasks, int(program.total_res_list.size()), program.instr_list.size(),
+                    int(checkpoints.size())};
+    out.append((const char*) header, sizeof(header));
+    for (const Checkpoint& checkpoint: checkpoints) {
+        checkpoint.append_to(out);
+    }
+
+    ofstream file(file_name.c_str(), ios::binary);
+    file.write(out.data(), out.size());
+    file.close();
+    return file.good();
+}
+
+
+bool read_checkpoints(const string& file_name, const Program& program, vector<Checkpoint>& checkpoints) {
+    /*
+     * Reads the checkpoints written by write_checkpoints. Returns false if the
+     * file cannot be read or was not written for the same program.
+     */
+    ifstream file(file_name.c_str(), ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    string in((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    int header[4];
+    if (in.size() < sizeof(CHECKPOINT_MAGIC) + sizeof(header) or
+        in.compare(0, sizeof(CHECKPOINT_MAGIC), CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0) {
+        return false;
+    }
+    memcpy(header, in.data() + sizeof(CHECKPOINT_MAGIC), sizeof(header));
+    if (header[0] != program.num_tasks or header[1] != program.total_res_list.size() or
+        header[2] != program.instr_list.size() or header[3] < 1 or header[3] > POLICY_BATCHED + 1) {
+        return false;
+    }
+
+    const char* pos = in.data() + sizeof(CHECKPOINT_MAGIC) + sizeof(header);
+    const char* end = in.data() + in.size();
+    checkpoints.resize(header[3]);
+    for (Checkpoint& checkpoint: checkpoints) {
+        if (!checkpoint.read_from(pos, end, program)) {
+            return false;
+        }
+    }
+    return pos == end;
+}
+
+
+enum TraceKind : unsigned char {
+    /*
+     * What happened to a task during a cycle, as recorded in trace mode.
+     */
+    TRACE_INITIATE,
+    TRACE_GRANT,
+    TRACE_WAIT,
+    TRACE_RELEASE,
+    TRACE_DELAY,
+    TRACE_TERMINATE,
+    TRACE_ABORT
+};
+
+
+struct TraceEvent {
+    /*
+     * One trace record: something that happened to a task during the cycles
+     * [cycle, cycle + cycles), involving amount units of a resource type (if any).
+     * A grant or wait of a request of several resource types is recorded once per
+     * part, every part after the first marked as an also.
+     */
+    long long cycle;
+    int cycles, task, amount;
+    unsigned short resource;
+    TraceKind kind;
+    bool also;
+};
+
+
+class TraceRing {
+    /*
+     * A fixed-size lock-free queue of trace records with a single producer (the
+     * thread running a ResManager) and a single consumer (the TraceWriter). The
+     * producer only waits if the writer has fallen a whole buffer behind.
+     */
+public:
+    explicit TraceRing(int log_size) : events(size_t(1) << log_size) {
+        mask = events.size() - 1;
+        head = 0;
+        tail = 0;
+        done = false;
+    }
+
+    void push(const TraceEvent& event) {
+        size_t pos = tail.load(memory_order_relaxed);
+        while (pos - head.load(memory_order_acquire) == events.size()) {
+            this_thread::yield();
+        }
+        events[pos & mask] = event;
+        tail.store(pos + 1, memory_order_release);
+    }
+
+    bool pop(TraceEvent& event) {
+        size_t pos = head.load(memory_order_relaxed);
+        if (pos == tail.load(memory_order_acquire)) {
+            return false;
+        }
+        event = events[pos & mask];
+        head.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+    void close() {
+        // Called by the producer once it will not push anything else.
+        done.store(true, memory_order_release);
+    }
+
+    bool closed() const {
+        return done.load(memory_order_acquire);
+    }
+
+private:
+    vector<TraceEvent> events;
+    size_t mask;
+    atomic<size_t> head, tail;
+    atomic<bool> done;
+};
+
+
+struct TraceSection {
+    /*
+     * The events of a cycle (or of cycles skipped at once), kept until no more
+     * can come for it, and whether each one concerns a task blocked before it.
+     */
+    long long start, end;
+    vector<TraceEvent> events;
+    vector<bool> blocked;
+};
+
+
+class TraceWriter {
+    /*
+     * Drains the trace rings of one or more runs on a background thread, so that
+     * the runs themselves only copy a small record per event. Renders them either
+     * as the cycle by cycle explanation of the '-detailed' sample outputs, one
+     * section per run, or as Chrome trace-event JSON (one process per run, one
+     * thread per task, one microsecond per cycle).
+     *
+     * As in the samples, every cycle first shows the checks of the tasks blocked
+     * before it, and a terminate, which takes no time, shows in the cycle of the
+     * task's last instruction (along with its release, if that was one). That
+     * terminate only happens during the next cycle, so each run keeps the last
+     * two cycles open. Every other cycle is written out as soon as it closes: the
+     * first run's straight into the file, the others' into a temporary file each,
+     * appended to it once every run is done.
+     */
+public:
+    TraceWriter() {
+        chrome = false;
+    }
+
+    bool open(const string& file_name, bool chrome_format) {
+        out.open(file_name.c_str());
+        chrome = chrome_format;
+        return out.good();
+    }
+
+    TraceRing* add_run(const string& name) {
+        // Must be called before start().
+        rings.emplace_back(new TraceRing(16));
+        names.emplace_back(name);
+        open_sections.emplace_back();
+        blocked.emplace_back();
+        finished_at.emplace_back();
+        return rings.back().get();
+    }
+
+    bool start() {
+        // Returns false if the temporary files of the text format cannot be created.
+        if (chrome) {
+            out << "{\"traceEvents\":[";
+            for (int run = 0; run < names.size(); run++) {
+                out << (run == 0 ? "\n" : ",\n") << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << run;
+                out << ",\"args\":{\"name\":\"" << names[run] << "\"}}";
+            }
+        } else {
+            for (int run = 0; run < names.size(); run++) {
+                if (run == 0) {
+                    out << names[run] << "\n";
+                    sections.emplace_back(&out);
+                } else if (!open_spill()) {
+                    return false;
+                }
+            }
+            rendered_any.assign(names.size(), false);
+        }
+        worker = thread(&TraceWriter::drain, this);
+        return true;
+    }
+
+    void finish() {
+        // Waits for every run's ring to be closed and emptied, then completes the file.
+        worker.join();
+        if (chrome) {
+            out << "\n]}\n";
+        } else {
+            for (int run = 0; run < names.size(); run++) {
+                for (const TraceSection& section: open_sections[run]) {
+                    render_section(run, section);
+                }
+                if (run > 0) {
+                    spills[run - 1]->seekg(0);
+                    out << "\n" << names[run] << "\n" << spills[run - 1]->rdbuf();
+                }
+            }
+        }
+        out.close();
+    }
+
+private:
+    vector<unique_ptr<TraceRing> > rings;
+    vector<string> names;
+    vector<ostream*> sections;
+    vector<unique_ptr<fstream> > spills;
+    vector<bool> rendered_any;
+    ofstream out;
+    bool chrome;
+    thread worker;
+
+    // Text format: the cycles of every run still open, whether every task is blocked
+    // on a request, and the cycle every task of the section being rendered finished at.
+    vector<vector<TraceSection> > open_sections;
+    vector<vector<bool> > blocked;
+    vector<vector<long long> > finished_at;
+
+    bool open_spill() {
+        // Adds a run written to a temporary file, removed as soon as it is open.
+        const char* dir = getenv("TMPDIR");
+        string path = string(dir != NULL ? dir : "/tmp") + "/resmanager-trace-XXXXXX";
+        vector<char> name(path.begin(), path.end());
+        name.emplace_back('\0');
+        int fd = mkstemp(name.data());
+        if (fd == -1) {
+            return false;
+        }
+        close(fd);
+        spills.emplace_back(new fstream(name.data(), ios::in | ios::out | ios::trunc));
+        unlink(name.data());
+        sections.emplace_back(spills.back().get());
+        return spills.back()->good();
+    }
+
+    void drain() {
+        bool all_closed = false;
+        while (!all_closed) {
+            // Check for closed rings before draining, so that nothing pushed before closing is missed.
+            all_closed = true;
+            for (const unique_ptr<TraceRing>& ring: rings) {
+                all_closed = all_closed and ring->closed();
+            }
+
+            bool drained_any = false;
+            TraceEvent event;
+            for (int run = 0; run < rings.size(); run++) {
+                while (rings[run]->pop(event)) {
+                    drained_any = true;
+                    if (chrome) {
+                        render_chrome(run, event);
+                    } else {
+                        render_text(run, event);
+                    }
+                }
+            }
+            if (!drained_any and !all_closed) {
+                this_thread::sleep_for(chrono::microseconds(100));
+            }
+        }
+    }
+
+    void render_text(int run, const TraceEvent& e) {
+        // Adds an event to its cycle, rendering the cycles no more events can come for.
+        vector<TraceSection>& open = open_sections[run];
+        vector<bool>& task_blocked = blocked[run];
+        if (e.task >= task_blocked.size()) {
+            task_blocked.resize(e.task + 1, false);
+        }
+        bool was_blocked = task_blocked[e.task];
+        task_blocked[e.task] = e.kind == TRACE_WAIT;
+
+        if (e.also and !open.empty()) {
+            // A later part of a request is shown along with the part before it.
+            open.back().events.emplace_back(e);
+            open.back().blocked.emplace_back(open.back().blocked.back());
+            return;
+        }
+
+        if (e.kind == TRACE_TERMINATE and !open.empty()) {
+            // The terminate belongs to the cycle before the one it happened in.
+            TraceSection& section = open.size() > 1 and open.back().start > e.cycle - 1 ? open.front() : open.back();
+            section.events.emplace_back(e);
+            section.blocked.emplace_back(false);
+            return;
+        }
+        if (open.empty() or e.cycle != open.back().start) {
+            if (open.size() == 2) {
+                render_section(run, open.front());
+                open.erase(open.begin());
+            }
+            open.emplace_back();
+            open.back().start = e.cycle;
+            open.back().end = e.cycle + e.cycles;
+        }
+        open.back().events.emplace_back(e);
+        open.back().blocked.emplace_back(was_blocked and (e.kind == TRACE_GRANT or e.kind == TRACE_WAIT));
+    }
+
+    void render_section(int run, const TraceSection& section) {
+        // Writes a cycle: the aborts, which come before any request is checked, then the
+        // checks of blocked tasks, then everything else in order.
+        ostream& text = *sections[run];
+        vector<long long>& finished = finished_at[run];
+        text << (rendered_any[run] ? "\n" : "") << "During " << section.start << "-" << section.end << "\n";
+        rendered_any[run] = true;
+        for (const TraceEvent& e: section.events) {
+            if (e.kind == TRACE_TERMINATE) {
+                if (e.task >= finished.size()) {
+                    finished.resize(e.task + 1, -1);
+                }
+                finished[e.task] = e.cycle;
+            }
+        }
+
+        for (const TraceEvent& e: section.events) {
+            if (e.kind == TRACE_ABORT) {
+                render_event(text, "   ", e);
+                text << "\n";
+            }
+        }
+        if (find(section.blocked.begin(), section.blocked.end(), true) != section.blocked.end()) {
+            text << "   First check blocked tasks:\n";
+            for (int k = 0; k < section.events.size(); k++) {
+                if (section.blocked[k]) {
+                    render_event(text, "      ", section.events[k]);
+                    text << "\n";
+                }
+            }
+        }
+        for (int k = 0; k < section.events.size(); k++) {
+            const TraceEvent& e = section.events[k];
+            bool merged = e.task < finished.size() and finished[e.task] != -1;
+            if (section.blocked[k] or e.kind == TRACE_ABORT or
+                (e.kind == TRACE_TERMINATE and merged and finished[e.task] == -2)) {
+                continue;
+            }
+            render_event(text, "   ", e);
+            if (e.kind == TRACE_RELEASE and merged) {
+                text << " and is finished (at " << finished[e.task] << ")";
+                finished[e.task] = -2;
+            }
+            text << "\n";
+        }
+        for (const TraceEvent& e: section.events) {
+            if (e.kind == TRACE_TERMINATE) {
+                finished[e.task] = -1;
+            }
+        }
+    }
+
+    static void render_event(ostream& text, const char* indent, const TraceEvent& e) {
+        text << indent << "Task " << e.task;
+        switch (e.kind) {
+        case TRACE_INITIATE:
+            text << " completes its initiate (claims " << e.amount << " of resource " << e.resource << ")";
+            break;
+        case TRACE_GRANT:
+            if (e.also) {
+                text << " also gets " << e.amount << " of resource " << e.resource << " with that request";
+                break;
+            }
+            text << " completes its request for " << e.amount << " of resource " << e.resource;
+            text << " (i.e. the request is granted)";
+            break;
+        case TRACE_WAIT:
+            if (e.also) {
+                text << "'s request also asks for " << e.amount << " of resource " << e.resource;
+                break;
+            }
+            text << "'s request for " << e.amount << " of resource " << e.resource << " cannot be granted";
+            break;
+        case TRACE_RELEASE:
+            text << " releases " << e.amount << " of resource " << e.resource;
+            break;
+        case TRACE_DELAY:
+            text << " is delayed";
+            break;
+        case TRACE_TERMINATE:
+            text << " is finished (at " << e.cycle << ")";
+            break;
+        case TRACE_ABORT:
+            text << " is aborted";
+            break;
+        }
+        if (e.cycles > 1) {
+            text << " (for " << e.cycles << " cycles)";
+        }
+    }
+
+    void render_chrome(int run, const TraceEvent& e) {
+        static const char* kind_names[] = {"initiate", "grant", "wait", "release", "delay", "terminate", "abort"};
+        out << ",\n{\"name\":\"" << kind_names[e.kind] << "\",\"ph\":\"X\",\"ts\":" << e.cycle;
+        out << ",\"dur\":" << e.cycles << ",\"pid\":" << run << ",\"tid\":" << e.task;
+        if (e.resource != 0) {
+            out << ",\"args\":{\"resource\":" << e.resource << ",\"units\":" << e.amount;
+            out << (e.also ? ",\"also\":true}" : "}");
+        }
+        out << "}";
+    }
+};
+
+
+class MessageStream : public ostream {
+    /*
+     * The messages of a run, kept in a string that can be reserved up front, so
+     * that writing them never allocates while the room lasts (an ostringstream
+     * grows as it goes).
+     */
+public:
+    MessageStream() : ostream(&buffer) {}
+
+    void reserve(size_t size) {
+        buffer.text.reserve(size);
+    }
+
+    size_t size() const {
+        return buffer.text.size();
+    }
+
+    const string& str() const {
+        return buffer.text;
+    }
+
+private:
+    struct Buffer : public streambuf {
+        string text;
+
+        int_type overflow(int_type c) {
+            if (c != traits_type::eof()) {
+                text.push_back(traits_type::to_char_type(c));
+            }
+            return c;
+        }
+
+        streamsize xsputn(const char* s, streamsize n) {
+            text.append(s, n);
+            return n;
+        }
+    };
+
+    Buffer buffer;
+};
+
+
+// The longest line a run writes to its messages, with every number at its widest.
+const int MESSAGE_LINE_BYTES = 128;
+
+
+class ResManager {
+    /*
+     * The state of a run of a resource managing algorithm over a program, and the
+     * steps every algorithm shares: the waiting queue, granting requests, skipping
+     * idle cycles, aborting deadlocked tasks, tracing and gathering the results.
+     * The cycle loop itself is in SimulationEngine, built once per policy. Any
+     * number of managers can run at the same time over the same program, each in
+     * its own thread.
+     */
+public:
+    const Program& program;
+    const InstructionList& instr_list;
+    const vector<int>& total_res_list;
+    Policy policy;
+    const char* name;
+    MessageStream messages;
+    vector<TaskResult> results;
+    double seconds;
+    TraceRing* trace_ring;
+
+    // If track_coupling is set, coupled tells whether any decision of the run may have
+    // depended on tasks that share no resource type with the task concerned. Only then
+    // does a run over part of a program differ from that part of a run over the whole.
+    bool track_coupling, coupled;
+
+    // A run told to stop_at() a cycle stops at its start, if it gets that far, leaving
+    // stopped set and its state in checkpoint. A run told to resume() from a checkpoint
+    // starts from it instead of the input.
+    Checkpoint checkpoint;
+    bool stopped;
+
+    // The tasks aborted to end a deadlock, and whether each abort reports the units it
+    // reclaimed and the work it discarded (the original report does not).
+    VictimPolicy victim_policy;
+    bool explain_aborts;
+
+    ResManager(const Program& prog, Policy pol, const char* policy_name)
+            : program(prog), instr_list(prog.instr_list), total_res_list(prog.total_res_list), initial_state(prog) {
+        // Start from the state described by the input.
+        state = initial_state;
+        policy = pol;
+        name = policy_name;
+        deadlock = false;
+        trace_ring = NULL;
+        track_coupling = false;
+        coupled = false;
+        stopped = false;
+        stop_cycle = LLONG_MAX;
+        resume_from = NULL;
+        victim_policy = VICTIM_LOWEST;
+        explain_aborts = false;
+    }
+
+    virtual ~ResManager() {}
+
+    void stop_at(long long cycle) {
+        stop_cycle = cycle;
+    }
+
+    void resume(const Checkpoint& from) {
+        // The checkpoint must outlive the run, and be of a run of the same policy over the same program.
+        resume_from = &from;
+    }
+
+    const vector<Task>& tasks() const {
+        return state.task_list;
+    }
+
+    void execute() {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        // Restore all original values as in the input.
+        reset();
+        reserve_scratch();
+
+        // Resolve all tasks using the policy.
+        run();
+        results = gather_results();
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (trace_ring != NULL) {
+            trace_ring->close();
+        }
+
+#ifdef RESMANAGER_DEBUG
+        if (loop_allocations > 0) {
+            cerr << loop_allocations << " heap allocations in the cycle loop during " << name << endl;
+        }
+#endif
+    }
+
+protected:
+    RunState initial_state, state;
+    WaitQueue waiting;
+    vector<int> released_res_list;
+    vector<int> blocked, blocked_start, blocked_head;
+    vector<int> victims, victim_order, type_blocked;
+    vector<long long> victim_cost, victim_freed;
+    int live_tasks;
+    long long stop_cycle;
+    bool deadlock, quiet;
+    const Checkpoint* resume_from;
+
+    // Scratch buffers, sized once per run so that the cycle loop never allocates.
+    vector<int> reqs, released_types;
+#ifdef RESMANAGER_DEBUG
+    long long cycle_allocations, loop_allocations;
+#endif
+
+    virtual void run() = 0;
+
+    void trace(TraceKind kind, long long cycle, int task_ind, int res_type = 0, int amount = 0, int cycles = 1,
+               bool also = false) {
+        // Records an event for the trace, if one is being written.
+        if (trace_ring == NULL) {
+            return;
+        }
+        TraceEvent event = {cycle, cycles, task_ind + 1, amount, (unsigned short) res_type, kind, also};
+        trace_ring->push(event);
+    }
+
+    int next_instruction(int task_ind) {
+        /*
+         * Returns the index in instr_list of the next instruction to be executed
+         * by the given task.
+         */
+        return program.task_start[task_ind] + state.task_list[task_ind].curr_instr;
+    }
+
+    int request_end(int ind) {
+        // Returns the index in instr_list past the last part of the request at ind (its alsos).
+        int end = ind + 1;
+        while (end < instr_list.size() and instr_list.opcode[end] == OP_ALSO) {
+            end++;
+        }
+        return end;
+    }
+
+    void abort_task(int task_ind, long long cycle) {
+        // Aborts a task, counting it out of the live tasks unless it already was.
+        if (!state.task_list[task_ind].aborted) {
+            live_tasks--;
+        }
+        state.task_list[task_ind].abort();
+        trace(TRACE_ABORT, cycle, task_ind);
+    }
+
+    void resolve_deadlock() {
+        /*
+         * Used by the optimistic policies at the start of every cycle: if every task
+         * still running is waiting, reports the deadlock and aborts tasks until the
+         * remaining ones can go on.
+         */
+        // If not all tasks are waiting, it might not be a deadlock.
+        deadlock = waiting.size == live_tasks;
+
+        // Will not do anything unless deadlock is set to true.
+        if (deadlock) {
+            messages << "Deadlock found during cycles " << state.cycle - 1 << "-" << state.cycle << " of " << name << endl;
+        }
+        handle_deadlock();
+    }
+
+    void handle_deadlock() {
+        /*
+         * Aborts tasks in the order of the victim policy while deadlocked. Every task
+         * still running is blocked on a request, so the deadlock ends as soon as the
+         * smallest request blocked on some resource fits in its available units. Those
+         * requests are sorted once, and an abort only needs to look at the smallest one
+         * left per resource. The victims are ranked once as well.
+         */
+        if (!deadlock) {
+            return;
+        }
+        sort_blocked();
+        rank_victims();
+
+        int next_victim = 0;
+        while (live_tasks > 0 and !request_unblocked()) {
+            // Cannot abort tasks that are completed or already aborted.
+            int to_abort = victims[next_victim++];
+            if (state.task_list[to_abort].complete or state.task_list[to_abort].aborted) {
+                continue;
+            }
+
+            messages << "    Task " << to_abort + 1 << " aborted";
+            if (explain_aborts) {
+                long long reclaimed = 0;
+                for (int res = 0; res < state.num_res; res++) {
+                    reclaimed += state.held_of(to_abort, res + 1);
+                }
+                messages << " (" << reclaimed << " units reclaimed, ";
+                messages << state.task_list[to_abort].work_done() << " cycles of work discarded)";
+            }
+            messages << endl;
+
+            // Abort next task.
+            abort_task(to_abort, state.cycle);
+            waiting.remove(to_abort);
+            quiet = false;
+            for (int res = 0; res < state.num_res; res++) {
+                state.current_res_list[res] += state.take_held(to_abort, res + 1);
+            }
+        }
+        deadlock = false;
+    }
+
+    void rank_victims() {
+        /*
+         * Lists the tasks still running in the order they are to be aborted, ties
+         * going to the task that appears first.
+         */
+        int num_tasks = state.task_list.size();
+        int num_res = state.num_res;
+        victims.clear();
+        for (int t = 0; t < num_tasks; t++) {
+            if (!state.task_list[t].complete and !state.task_list[t].aborted) {
+                victims.emplace_back(t);
+            }
+        }
+        if (victim_policy == VICTIM_LOWEST) {
+            return;
+        } else if (victim_policy == VICTIM_MIN_SET) {
+            rank_min_set();
+            return;
+        }
+
+        // Every other policy sorts by a cost, lowest first.
+        if (victim_policy == VICTIM_MOST_FREED) {
+            mark_blocked_types();
+        }
+        victim_cost.assign(num_tasks, 0);
+        for (int t: victims) {
+            for (int res = 0; res < num_res; res++) {
+                int held = state.held[t * num_res + res];
+                if (victim_policy == VICTIM_FEWEST_HELD) {
+                    victim_cost[t] += held;
+                } else if (victim_policy == VICTIM_MOST_FREED and type_blocked[res]) {
+                    victim_cost[t] -= held;
+                }
+            }
+            if (victim_policy == VICTIM_LEAST_PROGRESS) {
+                victim_cost[t] = state.task_list[t].work_done();
+            }
+        }
+        // Least progress also counts the instructions done, as a task may have spent its cycles waiting.
+        // Ties go to the lower task number: a stable sort would take a buffer from the heap.
+        sort(victims.begin(), victims.end(), [this](int a, int b) {
+            if (victim_cost[a] != victim_cost[b]) {
+                return victim_cost[a] < victim_cost[b];
+            }
+            if (victim_policy == VICTIM_LEAST_PROGRESS and
+                state.task_list[a].curr_instr != state.task_list[b].curr_instr) {
+                return state.task_list[a].curr_instr < state.task_list[b].curr_instr;
+            }
+            return a < b;
+        });
+    }
+
+    void rank_min_set() {
+        /*
+         * Finds, for every resource with blocked requests, the fewest tasks whose
+         * units let the smallest of those requests through, taking the tasks that
+         * hold the most units of it first (a task aborted that way no longer waits
+         * itself, so the next smallest request counts from then on). The smallest
+         * such set goes first, ties going to the one discarding the least work, then
+         * every other task in order of appearance, in case it is not enough. A request
+         * of several resource types is a candidate of its own, through once every one
+         * of its parts fits.
+         */
+        int num_res = state.num_res;
+        int best_res = -1, best_count = 0;
+        long long best_work = 0;
+        for (int res = 0; res < num_res; res++) {
+            if (blocked_start[res + 1] == blocked_start[res]) {
+                continue;
+            }
+            rank_holders(res);
+
+            long long available = state.current_res_list[res], work = 0;
+            int head = blocked_start[res];
+            for (int count = 0; count <= victim_order.size(); count++) {
+                while (head < blocked_start[res + 1] and state.task_list[blocked[head]].aborted) {
+                    head++;
+                }
+                if (head < blocked_start[res + 1] and instr_list.amount[next_instruction(blocked[head])] <= available) {
+                    if (best_res == -1 or count < best_count or (count == best_count and work < best_work)) {
+                        best_res = res;
+                        best_count = count;
+                        best_work = work;
+                    }
+                    break;
+                }
+                if (count == victim_order.size()) {
+                    break;
+                }
+
+                // Count the task out as if it were aborted, and its units back.
+                int t = victim_order[count];
+                available += state.held[t * num_res + res];
+                work += state.task_list[t].work_done();
+                if (head < blocked_start[res + 1] and blocked[head] == t) {
+                    head++;
+                }
+            }
+        }
+        for (int k = blocked_start[num_res]; k < blocked_start[num_res + 1]; k++) {
+            rank_request_holders(blocked[k]);
+
+            int ind = next_instruction(blocked[k]);
+            int end = request_end(ind);
+            long long work = 0;
+            victim_freed.assign(end - ind, 0);
+            for (int count = 0; count <= victim_order.size(); count++) {
+                bool fits = true;
+                for (int i = ind; i < end; i++) {
+                    int res = instr_list.resource_type[i] - 1;
+                    fits = fits and instr_list.amount[i] <= state.current_res_list[res] + victim_freed[i - ind];
+                }
+                if (fits) {
+                    if (best_res == -1 or count < best_count or (count == best_count and work < best_work)) {
+                        best_res = num_res + k;
+                        best_count = count;
+                        best_work = work;
+                    }
+                    break;
+                }
+                if (count == victim_order.size()) {
+                    break;
+                }
+
+                // Count the task out as if it were aborted, and its units of every part back.
+                int t = victim_order[count];
+                for (int i = ind; i < end; i++) {
+                    victim_freed[i - ind] += state.held[t * num_res + instr_list.resource_type[i] - 1];
+                }
+                work += state.task_list[t].work_done();
+            }
+        }
+        if (best_res == -1) {
+            return;
+        }
+
+        // The set found goes first, then the rest as they were.
+        if (best_res < num_res) {
+            rank_holders(best_res);
+        } else {
+            rank_request_holders(blocked[best_res - num_res]);
+        }
+        victim_order.resize(best_count);
+        victim_cost.assign(state.task_list.size(), 0);
+        for (int t: victim_order) {
+            victim_cost[t] = 1;
+        }
+        for (int t: victims) {
+            if (victim_cost[t] == 0) {
+                victim_order.emplace_back(t);
+            }
+        }
+        victims.swap(victim_order);
+    }
+
+    void rank_holders(int res) {
+        // Lists the tasks still running that hold units of a resource, most units first.
+        int num_res = state.num_res;
+        victim_order.clear();
+        for (int t: victims) {
+            if (state.held[t * num_res + res] > 0) {
+                victim_order.emplace_back(t);
+            }
+        }
+        sort(victim_order.begin(), victim_order.end(), [this, num_res, res](int a, int b) {
+            int held_a = state.held[a * num_res + res], held_b = state.held[b * num_res + res];
+            return held_a != held_b ? held_a > held_b : a < b;
+        });
+    }
+
+    void rank_request_holders(int task_ind) {
+        /*
+         * Lists the other tasks still running that hold units of any type a blocked
+         * request of several resource types asks for, most of those units first.
+         */
+        int num_res = state.num_res;
+        int ind = next_instruction(task_ind);
+        int end = request_end(ind);
+        victim_order.clear();
+        victim_cost.assign(state.task_list.size(), 0);
+        for (int t: victims) {
+            for (int i = ind; i < end; i++) {
+                victim_cost[t] += state.held[t * num_res + instr_list.resource_type[i] - 1];
+            }
+            if (t != task_ind and victim_cost[t] > 0) {
+                victim_order.emplace_back(t);
+            }
+        }
+        sort(victim_order.begin(), victim_order.end(), [this](int a, int b) {
+            return victim_cost[a] != victim_cost[b] ? victim_cost[a] > victim_cost[b] : a < b;
+        });
+    }
+
+    void mark_blocked_types() {
+        // Marks the resource types some blocked request asks for, every part of it.
+        int num_res = state.num_res;
+        type_blocked.assign(num_res, 0);
+        for (int res = 0; res < num_res; res++) {
+            type_blocked[res] = int(blocked_start[res + 1] > blocked_start[res]);
+        }
+        for (int k = blocked_start[num_res]; k < blocked_start[num_res + 1]; k++) {
+            int ind = next_instruction(blocked[k]);
+            int end = request_end(ind);
+            for (int i = ind; i < end; i++) {
+                type_blocked[instr_list.resource_type[i] - 1] = 1;
+            }
+        }
+    }
+
+    void sort_blocked() {
+        /*
+         * Groups the tasks in the waiting queue by the resource they are requesting,
+         * smallest request first within each resource. Requests of several resource
+         * types at once make up one more group, after the others, in queue order.
+         */
+        int num_res = total_res_list.size();
+        blocked_start.assign(num_res + 2, 0);
+        for (int task_ind = waiting.head; task_ind != -1; task_ind = waiting.next[task_ind]) {
+            blocked_start[blocked_group(task_ind) + 1]++;
+        }
+        partial_sum(blocked_start.begin(), blocked_start.end(), blocked_start.begin());
+
+        blocked.resize(waiting.size);
+        blocked_head.assign(blocked_start.begin(), blocked_start.end() - 1);
+        for (int task_ind = waiting.head; task_ind != -1; task_ind = waiting.next[task_ind]) {
+            blocked[blocked_head[blocked_group(task_ind)]++] = task_ind;
+        }
+
+        for (int res = 0; res < num_res; res++) {
+            blocked_head[res] = blocked_start[res];
+            sort(blocked.begin() + blocked_start[res], blocked.begin() + blocked_start[res + 1], [this](int a, int b) {
+                return instr_list.amount[next_instruction(a)] < instr_list.amount[next_instruction(b)];
+            });
+        }
+    }
+
+    int blocked_group(int task_ind) {
+        // The resource a blocked task is requesting (from 0), or the number of resources if it requests several.
+        int ind = next_instruction(task_ind);
+        return request_end(ind) - ind > 1 ? total_res_list.size() : instr_list.resource_type[ind] - 1;
+    }
+
+    bool request_unblocked() {
+        /*
+         * Check if the smallest request still blocked on any resource can be
+         * satisfied, skipping the tasks aborted since the requests were sorted.
+         * Requests of several resource types are checked one by one.
+         */
+        int num_res = total_res_list.size();
+        for (int res = 0; res < num_res; res++) {
+            int& head = blocked_head[res];
+            while (head < blocked_start[res + 1] and state.task_list[blocked[head]].aborted) {
+                head++;
+            }
+            if (head < blocked_start[res + 1] and
+                instr_list.amount[next_instruction(blocked[head])] <= state.current_res_list[res]) {
+                return true;
+            }
+        }
+        for (int k = blocked_start[num_res]; k < blocked_start[num_res + 1]; k++) {
+            if (!state.task_list[blocked[k]].aborted and units_available(blocked[k])) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void skip_idle_cycles() {
+        /*
+         * If nothing but waits and delays happened during the last cycle, the waiting
+         * tasks will keep failing their checks until some delayed task gets to run.
+         * Jumps straight to that cycle, crediting the skipped cycles to every task at
+         * once, exactly as if they had been executed one by one.
+         */
+        if (!quiet) {
+            quiet = true;
+            return;
+        }
+
+        // Find the number of cycles until the first delayed instruction is ready.
+        int skip = INT_MAX;
+        for (int i = 0; i < state.task_list.size(); i++) {
+            if (state.task_list[i].aborted or state.task_list[i].complete or waiting.queued[i]) {
+                continue;
+            }
+            skip = min(skip, instr_list.delay[next_instruction(i)] - state.task_list[i].delay_spent);
+        }
+        skip = int(min<long long>(skip, stop_cycle - state.cycle));
+        if (skip <= 0 or skip == INT_MAX) {
+            return;
+        }
+
+        for (int i = 0; i < state.task_list.size(); i++) {
+            if (state.task_list[i].aborted or state.task_list[i].complete) {
+                continue;
+            } else if (waiting.queued[i]) {
+                state.task_list[i].wait(skip);
+                trace_wait(i, skip);
+            } else {
+                state.task_list[i].delay(skip);
+                trace(TRACE_DELAY, state.cycle, i, 0, 0, skip);
+            }
+        }
+        state.cycle += skip;
+    }
+
+    void restore_checkpoint() {
+        // Starts from the checkpoint given to resume(), messages included, instead of the input.
+        state = resume_from->state;
+        for (int task_ind: resume_from->waiting_order) {
+            waiting.push_back(task_ind);
+        }
+        live_tasks = 0;
+        for (const Task& t: state.task_list) {
+            live_tasks += int(!t.aborted and !t.complete);
+        }
+        messages << resume_from->messages;
+    }
+
+    void take_checkpoint() {
+        // Keeps the state at the start of the current cycle, once the units released before it are back.
+        checkpoint.policy = policy;
+        checkpoint.state = state;
+        checkpoint.waiting_order.clear();
+        for (int task_ind = waiting.head; task_ind != -1; task_ind = waiting.next[task_ind]) {
+            checkpoint.waiting_order.emplace_back(task_ind);
+        }
+        checkpoint.messages = messages.str();
+        stopped = true;
+    }
+
+    void return_units(int res_ind, int amount) {
+        // Gives units back to the manager; they are available from the next cycle on.
+        if (released_res_list[res_ind] == 0) {
+            released_types.emplace_back(res_ind);
+        }
+        released_res_list[res_ind] += amount;
+    }
+
+    void grant_request(int task_ind) {
+        // Gives a task the units of its next instruction's request, every part of it.
+        quiet = false;
+        int ind = next_instruction(task_ind);
+        int end = request_end(ind);
+        for (int i = ind; i < end; i++) {
+            if (i == ind) {
+                state.granted(task_ind, instr_list.resource_type[i], instr_list.amount[i]);
+            } else {
+                state.granted_also(task_ind, instr_list.resource_type[i], instr_list.amount[i]);
+            }
+            trace(TRACE_GRANT, state.cycle, task_ind, instr_list.resource_type[i], instr_list.amount[i], 1, i != ind);
+            state.current_res_list[instr_list.resource_type[i] - 1] -= instr_list.amount[i];
+        }
+    }
+
+    void trace_wait(int task_ind, int cycles = 1) {
+        // Records that a task's request, every part of it, was not granted for the given number of cycles.
+        if (trace_ring == NULL) {
+            return;
+        }
+        int ind = next_instruction(task_ind);
+        int end = request_end(ind);
+        for (int i = ind; i < end; i++) {
+            trace(TRACE_WAIT, state.cycle, task_ind, instr_list.resource_type[i], instr_list.amount[i], cycles, i != ind);
+        }
+    }
+
+    bool units_available(int task_ind) {
+        /*
+         * Check if the task's 'require' instruction can be satisfied or not, all
+         * of its parts at once.
+         */
+        int ind = next_instruction(task_ind);
+        int end = request_end(ind);
+        for (int i = ind; i < end; i++) {
+            if (state.current_res_list[instr_list.resource_type[i] - 1] < instr_list.amount[i]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    vector<TaskResult> gather_results() {
+        /*
+         * Collects the results of every task, to be printed. A task counts as aborted
+         * if its time is still the -1 left by abort(), as the table always did.
+         */
+        vector<TaskResult> results;
+        for (const Task& t: state.task_list) {
+            bool aborted = t.time_taken == -1;
+            TaskResult result = {aborted ? 0 : t.time_taken, aborted ? 0 : t.waiting_time, aborted};
+            results.emplace_back(result);
+        }
+        return results;
+    }
+
+    void reset() {
+        /*
+         * Sets all the values to their initial positions after an algorithm has
+         * already been completed for the next algorithm to do so as well.
+         */
+        state = initial_state;
+    }
+
+    void reserve_scratch() {
+        /*
+         * Sizes every buffer the cycle loop uses for the largest number of tasks and
+         * resource types it may have to hold, so that they are only ever reused.
+         * Policies size their own buffers in setup().
+         */
+        int num_tasks = state.task_list.size();
+        int num_res = total_res_list.size();
+
+        reqs.reserve(num_tasks);
+        released_types.reserve(num_tasks + num_res);
+        blocked.reserve(num_tasks);
+        blocked_start.reserve(num_res + 2);
+        blocked_head.reserve(num_res + 1);
+        victims.reserve(num_tasks);
+        victim_order.reserve(num_tasks);
+        victim_cost.reserve(num_tasks);
+        victim_freed.reserve(num_res);
+        type_blocked.reserve(num_res);
+
+        // Every initiate leads to at most two lines (a claim refused, or a request exceeding it
+        // aborted), and so does every task (a deadlock found, and the task aborted during it).
+        size_t lines = 2 * (program.initiate_list.size() + state.task_list.size() + 1);
+        messages.reserve(lines * MESSAGE_LINE_BYTES + (resume_from != NULL ? resume_from->messages.size() : 0));
+
+#ifdef RESMANAGER_DEBUG
+        loop_allocations = 0;
+#endif
+    }
+
+    void start_cycle_check() {
+        // Debug builds: remembers the allocations before the cycle.
+#ifdef RESMANAGER_DEBUG
+        cycle_allocations = allocation_count;
+#endif
+    }
+
+    void end_cycle_check() {
+        // Debug builds: counts the allocations of the cycle, messages included.
+#ifdef RESMANAGER_DEBUG
+        loop_allocations += allocation_count - cycle_allocations;
+#endif
+    }
+};
+
+
+template <class Derived>
+class SimulationEngine : public ResManager {
+    /*
+     * The cycle loop shared by every policy. A policy derives from SimulationEngine
+     * of itself, provides admit() (whether a pending request can be granted now)
+     * and replaces whichever hooks below it needs. Hooks are called through the
+     * derived type, so each policy gets its own copy of the loop with its checks
+     * inlined and nothing decided at runtime.
+     */
+public:
+    SimulationEngine(const Program& prog, Policy pol, const char* policy_name) : ResManager(prog, pol, policy_name) {}
+
+protected:
+    Derived& derived() {
+        return *static_cast<Derived*>(this);
+    }
+
+    void run() {
+        waiting.reset(state.task_list.size());
+        live_tasks = state.task_list.size();
+        released_res_list.assign(total_res_list.size(), 0);
+        derived().setup();
+
+        if (resume_from != NULL) {
+            // Carry on from a checkpoint, where every task was initiated long ago.
+            restore_checkpoint();
+        } else {
+            // Initiate all the tasks in round zero.
+            for (int ind: program.initiate_list) {
+                int task_ind = program.task_of(ind);
+                int res_type = instr_list.resource_type[ind];
+                int claim = instr_list.amount[ind];
+                if (derived().validate_initiate(task_ind, res_type, claim)) {
+                    state.initiate(task_ind, res_type, claim);
+                    trace(TRACE_INITIATE, 0, task_ind, res_type, claim);
+                }
+            }
+        }
+        derived().start();
+
+        // Loop through all the instructions until all resources have been terminated or aborted.
+        // The first cycle is never skipped, which a resumed run relies on (skipping is only a shortcut).
+        bool finished = false;
+        quiet = false;
+        while (!finished) {
+            // Jump over the cycles in which tasks can only wait or be delayed, but not past the one to stop at.
+            skip_idle_cycles();
+            if (state.cycle >= stop_cycle) {
+                take_checkpoint();
+                return;
+            }
+            start_cycle_check();
+            derived().start_cycle();
+
+            int t_num = 1;
+
+            // List needed to execute 'require's.
+            reqs.clear();
+
+            // Loops through all the tasks identifying the next instruction to be executed for each task.
+            for (const Task& t: state.task_list) {
+                if (t.aborted or t.complete) {
+                    t_num++;
+                    continue;
+                }
+                int ins_ind = next_instruction(t_num - 1);
+
+                // Only execute instructions whose delay has passed.
+                if (t.delay_spent == instr_list.delay[ins_ind]) {
+                    // Anything other than a request that keeps waiting changes the state.
+                    if (!waiting.queued[t_num - 1]) {
+                        quiet = false;
+                    }
+
+                    switch (instr_list.opcode[ins_ind]) {
+                    // If the next instruction is a new request the policy accepts, add its task to the
+                    // list of requests. Tasks that are already waiting keep their place in the queue.
+                    case OP_REQUEST:
+                        if (!waiting.queued[t_num - 1] and derived().validate_request(t_num - 1, ins_ind)) {
+                            reqs.emplace_back(t_num - 1);
+                        }
+                        break;
+
+                    // If the next instruction is a release, release from the task. The units are
+                    // given back to the manager at the end of the cycle.
+                    case OP_RELEASE: {
+                        int res_type = instr_list.resource_type[ins_ind];
+                        int amount = instr_list.amount[ins_ind];
+                        state.release(t_num - 1, res_type, amount);
+                        trace(TRACE_RELEASE, state.cycle, t_num - 1, res_type, amount);
+                        return_units(res_type - 1, amount);
+                        derived().on_release(t_num - 1, res_type, amount);
+                        break;
+                    }
+
+                    // If the next instruction is a terminate, terminate the task.
+                    case OP_TERMINATE:
+                        derived().on_terminate(t_num - 1);
+                        state.task_list[t_num - 1].terminate();
+                        trace(TRACE_TERMINATE, state.cycle, t_num - 1);
+                        live_tasks--;
+                        break;
+
+                    default:
+                        break;
+                    }
+
+                // If the delay has not passed, delay the task.
+                } else {
+                    state.task_list[t_num - 1].delay();
+                    trace(TRACE_DELAY, state.cycle, t_num - 1);
+                }
+
+                t_num++;
+            }
+
+            // Go through the tasks that have requested this cycle and execute them when possible.
+            derived().serve(reqs);
+
+            // Add the released resources back to the manager at the end of the cycle.
+            for (int res_ind: released_types) {
+                state.current_res_list[res_ind] += released_res_list[res_ind];
+                derived().on_return(res_ind, released_res_list[res_ind]);
+                released_res_list[res_ind] = 0;
+            }
+            released_types.clear();
+
+            // If all tasks are finished or aborted, end.
+            finished = live_tasks == 0;
+            state.cycle++;
+            end_cycle_check();
+        }
+    }
+
+    // The hooks a policy can replace. By default every claim and request is valid,
+    // nothing else happens along the way and requests are served in FIFO order.
+
+    void setup() {
+        // Before the run: sizes the policy's own buffers.
+    }
+
+    bool validate_initiate(int /* task_ind */, int /* res_type */, int /* claim */) {
+        // Whether a task's claim is accepted. If not, the policy deals with the task.
+        return true;
+    }
+
+    void start() {
+        // After every task has been initiated.
+    }
+
+    void start_cycle() {
+        // At the start of every cycle executed.
+    }
+
+    bool validate_request(int /* task_ind */, int /* ins_ind */) {
+        // Whether a new request is accepted. If not, the policy deals with the task.
+        return true;
+    }
+
+    void on_release(int /* task_ind */, int /* res_type */, int /* amount */) {
+        // After a task releases units, which come back at the end of the cycle.
+    }
+
+    void on_terminate(int /* task_ind */) {
+        // Right before a task terminates.
+    }
+
+    void on_return(int /* res_ind */, int /* amount */) {
+        // After the units released during the cycle are available again.
+    }
+
+    void serve(const vector<int>& reqs) {
+        /*
+         * Grants the pending requests the policy admits, in order of priority: first
+         * the tasks in the waiting queue, then the new requests (reqs, in task
+         * order). New requests that cannot be granted join the back of the queue.
+         */
+        for (int task_ind = waiting.head; task_ind != -1; ) {
+            int next = waiting.next[task_ind];
+            if (derived().admit(task_ind)) {
+                waiting.remove(task_ind);
+                grant_request(task_ind);
+            } else {
+                state.task_list[task_ind].wait();
+                trace_wait(task_ind);
+            }
+            task_ind = next;
+        }
+
+        for (int task_ind: reqs) {
+            if (derived().admit(task_ind)) {
+                grant_request(task_ind);
+            } else {
+                state.task_list[task_ind].wait();
+                trace_wait(task_ind);
+                waiting.push_back(task_ind);
+            }
+        }
+    }
+};
+
+
+class FifoManager : public SimulationEngine<FifoManager> {
+    /*
+     * The optimistic resource manager: grants every request the available units
+     * can satisfy, first come first served, and aborts tasks when they deadlock.
+     */
+    friend class SimulationEngine<FifoManager>;
+
+public:
+    explicit FifoManager(const Program& prog) : SimulationEngine(prog, POLICY_FIFO, "FIFO") {}
+
+private:
+    void start_cycle() {
+        resolve_deadlock();
+    }
+
+    bool admit(int task_ind) {
+        return units_available(task_ind);
+    }
+};
+
+
+template <class Derived>
+class BankersEngine : public SimulationEngine<Derived> {
+    /*
+     * Dijkstra's Banker's algorithm: a task can neither claim more units than are
+     * present nor request more than it claimed, and a request is only granted if
+     * the state it leads to is safe. A safe sequence is kept cached along with the
+     * slack of every task in it, so most requests are checked without running the
+     * complete safety algorithm. Policies built on it decide in what order the
+     * pending requests are checked (see BankersManager and BatchedBankersManager).
+     */
+    friend class SimulationEngine<Derived>;
+
+public:
+    BankersEngine(const Program& prog, Policy pol, const char* policy_name)
+            : SimulationEngine<Derived>(prog, pol, policy_name) {
+        sequence_valid = false;
+    }
+
+protected:
+    // The base depends on Derived, so the members of ResManager in use are named here.
+    using ResManager::program;
+    using ResManager::instr_list;
+    using ResManager::total_res_list;
+    using ResManager::messages;
+    using ResManager::track_coupling;
+    using ResManager::coupled;
+    using ResManager::state;
+    using ResManager::waiting;
+    using ResManager::released_res_list;
+    using ResManager::released_types;
+    using ResManager::next_instruction;
+    using ResManager::request_end;
+    using ResManager::abort_task;
+    using ResManager::return_units;
+    using ResManager::units_available;
+
+    vector<int> safe_sequence;
+    vector<int> safe_position;
+    vector<SlackTree> slack;
+    int short_res;
+    bool sequence_valid;
+
+    // Scratch buffers of the safety algorithm.
+    vector<int> live_list, sequence;
+    vector<bool> done;
+    vector<int> available;
+    vector<long long> work;
+    vector<vector<long long> > slack_values;
+
+    void setup() {
+        int num_tasks = state.task_list.size();
+        int num_res = total_res_list.size();
+
+        live_list.reserve(num_tasks);
+        sequence.reserve(num_tasks);
+        safe_sequence.reserve(num_tasks);
+        safe_position.reserve(num_tasks);
+        done.reserve(num_tasks);
+        work.reserve(num_res);
+        available.reserve(num_res);
+        slack_values.resize(num_res);
+        slack.resize(num_res);
+        for (int r = 0; r < num_res; r++) {
+            slack_values[r].reserve(num_tasks);
+            slack[r].tree.reserve(4 * max(num_tasks, 1));
+            slack[r].lazy.reserve(4 * max(num_tasks, 1));
+        }
+    }
+
+    bool validate_initiate(int task_ind, int res_type, int claim) {
+        // Check whether the claim is valid.
+        if (claim <= total_res_list[res_type - 1]) {
+            return true;
+        }
+
+        // If not, abort.
+        abort_task(task_ind, 0);
+        messages << "Banker aborts task " << task_ind + 1 << " before run begins:" << endl;
+        messages << "    claim for resource " << res_type << " (" << claim << ") ";
+        messages << "exceeds number of units present (" << total_res_list[res_type - 1] << ")" << endl;
+        return false;
+    }
+
+    void start() {
+        // Every state reached from here on must be safe, starting with the initial (or restored) one.
+        sequence_valid = build_safe_sequence(-1);
+    }
+
+    bool validate_request(int task_ind, int ins_ind) {
+        // Check whether it's a valid one, every part of it.
+        bool valid = true;
+        int end = request_end(ins_ind);
+        for (int i = ins_ind; i < end; i++) {
+            valid = valid and instr_list.amount[i] <= state.need_of(task_ind, instr_list.resource_type[i]);
+        }
+        if (valid) {
+            return true;
+        }
+
+        // If not, abort.
+        leave_safe_sequence(task_ind);
+        abort_task(task_ind, state.cycle);
+        for (int i = program.task_start[task_ind]; i < program.task_start[task_ind + 1]; i++) {
+            if (instr_list.opcode[i] != OP_INITIATE) {
+                continue;
+            }
+            return_units(instr_list.resource_type[i] - 1, state.take_held(task_ind, instr_list.resource_type[i]));
+            messages << "During cycles " << state.cycle << "-" << state.cycle + 1 << " of Banker's algorithms";
+            messages << endl << "    Task " << task_ind + 1 << "'s request exceeds its claim; aborted; ";
+            messages << accumulate(released_res_list.begin(), released_res_list.end(), 0);
+            messages << " units available next cycle" << endl;
+        }
+        return false;
+    }
+
+    void on_release(int task_ind, int res_type, int amount) {
+        if (sequence_valid) {
+            // Until the units are back, the releasing task and every task after it
+            // have fewer units to work with.
+            adjust_slack(res_type - 1, safe_position[task_ind], safe_sequence.size(), -amount);
+        }
+    }
+
+    void on_terminate(int task_ind) {
+        leave_safe_sequence(task_ind);
+    }
+
+    void on_return(int res_ind, int amount) {
+        if (sequence_valid and amount > 0) {
+            adjust_slack(res_ind, 0, safe_sequence.size(), amount);
+        }
+    }
+
+    bool admit(int task_ind) {
+        return bankers_check(task_ind);
+    }
+
+    void serve(const vector<int>& reqs) {
+        check_coupling();
+        SimulationEngine<Derived>::serve(reqs);
+    }
+
+    void check_coupling() {
+        // While units released this cycle are on their way back, the state can be unsafe,
+        // and then no request is granted: not even those of tasks sharing no resource type
+        // with the ones left short, so runs over parts of a program need to know.
+        if (track_coupling and !released_types.empty() and (!sequence_valid or short_res > 0)) {
+            sequence_valid = build_safe_sequence(-1);
+            coupled = coupled or !sequence_valid;
+        }
+    }
+
+    void apply_request(int task_ind, int sign) {
+        // Grants a task's request in the matrices and the units available (sign 1), or undoes it (sign -1).
+        int ind = next_instruction(task_ind);
+        int end = request_end(ind);
+        for (int i = ind; i < end; i++) {
+            int cell = task_ind * state.num_res + instr_list.resource_type[i] - 1;
+            int num = sign * instr_list.amount[i];
+            available[instr_list.resource_type[i] - 1] -= num;
+            state.need[cell] -= num;
+            state.held[cell] += num;
+        }
+    }
+
+    void gather_live() {
+        // Lists the tasks still running.
+        live_list.clear();
+        for (int t = 0; t < state.task_list.size(); t++) {
+            if (!state.task_list[t].aborted and !state.task_list[t].complete) {
+                live_list.emplace_back(t);
+            }
+        }
+    }
+
+    bool bankers_check(int task_ind) {
+        /*
+         * Checks whether the current task requesting resources is allowed to
+         * according to Banker's algorithm, i.e. whether the state after granting
+         * the request is still safe. If it is, the safe sequence is updated as if
+         * the request had already been granted.
+         */
+        if (!units_available(task_ind)) {
+            return false;
+        }
+
+        // Granting leaves fewer units for every task before the requesting one in the cached
+        // sequence, and nothing changes for the rest. If the sequence is still complete
+        // (releases during this cycle may have left some tasks short until the next one),
+        // only the requested resource types need to be checked.
+        int ind = next_instruction(task_ind);
+        int end = request_end(ind);
+        if (sequence_valid and short_res == 0) {
+            int pos = safe_position[task_ind];
+            bool fits = true;
+            for (int i = ind; i < end; i++) {
+                fits = fits and slack[instr_list.resource_type[i] - 1].min_of(0, pos) >= instr_list.amount[i];
+            }
+            if (fits) {
+                for (int i = ind; i < end; i++) {
+                    adjust_slack(instr_list.resource_type[i] - 1, 0, pos, -instr_list.amount[i]);
+                }
+                return true;
+            }
+        }
+
+        // Otherwise, look for a different safe sequence for the state after the grant.
+        if (build_safe_sequence(task_ind)) {
+            sequence_valid = true;
+            return true;
+        }
+        return false;
+    }
+
+    bool build_safe_sequence(int grant_task) {
+        /*
+         * Runs the complete safety algorithm over all live tasks, as if grant_task's
+         * request had been granted (if it isn't -1). Units released this cycle are
+         * not available until the next one, so they are not counted. If the state is
+         * safe, caches the sequence found and returns true.
+         */
+        int num_res = state.num_res;
+        const vector<int>& need = state.need;
+        const vector<int>& held = state.held;
+        gather_live();
+
+        // The grant is applied to the matrices while checking, and undone afterwards.
+        available.assign(state.current_res_list.begin(), state.current_res_list.end());
+        if (grant_task != -1) {
+            apply_request(grant_task, 1);
+        }
+        work.assign(available.begin(), available.end());
+
+        // Repeatedly let any task whose remaining claims fit finish and return its units.
+        done.assign(state.task_list.size(), false);
+        bool safe = find_safe_sequence(need.data(), held.data(), num_res, live_list, available, done, sequence);
+
+        // Cache the sequence along with the slack of every task in it.
+        if (safe) {
+            safe_sequence.swap(sequence);
+            safe_position.assign(state.task_list.size(), 0);
+            vector<vector<long long> >& values = slack_values;
+            for (int r = 0; r < num_res; r++) {
+                values[r].resize(safe_sequence.size());
+            }
+            for (int k = 0; k < safe_sequence.size(); k++) {
+                int t = safe_sequence[k];
+                safe_position[t] = k;
+                for (int r = 0; r < num_res; r++) {
+                    values[r][k] = work[r] - need[t * num_res + r];
+                    work[r] += held[t * num_res + r];
+                }
+            }
+            for (int r = 0; r < num_res; r++) {
+                slack[r].build(values[r]);
+            }
+            short_res = 0;
+        }
+
+        if (grant_task != -1) {
+            apply_request(grant_task, -1);
+        }
+        return safe;
+    }
+
+    void leave_safe_sequence(int task_ind) {
+        /*
+         * Takes a task that is aborting or terminating out of the cached safe sequence.
+         * Whatever it still holds is no longer returned to the tasks after it (an
+         * aborted task's units only come back at the end of the cycle).
+         */
+        if (!sequence_valid) {
+            return;
+        }
+
+        int pos = safe_position[task_ind];
+        for (int r = 0; r < slack.size(); r++) {
+            bool was_short = slack[r].min_of(0, safe_sequence.size()) < 0;
+            int held = state.held_of(task_ind, r + 1);
+            if (held > 0) {
+                slack[r].add(pos + 1, safe_sequence.size(), -held);
+            }
+            slack[r].remove(pos);
+            short_res += int(slack[r].min_of(0, safe_sequence.size()) < 0) - int(was_short);
+        }
+    }
+
+    void adjust_slack(int res_ind, int lo, int hi, long long value) {
+        /*
+         * Adds value to the slack of a range of positions of the cached safe sequence,
+         * keeping count of the resource types some task is short of.
+         */
+        bool was_short = slack[res_ind].min_of(0, safe_sequence.size()) < 0;
+        slack[res_ind].add(lo, hi, value);
+        short_res += int(slack[res_ind].min_of(0, safe_sequence.size()) < 0) - int(was_short);
+    }
+};
+
+
+class BankersManager : public BankersEngine<BankersManager> {
+    /*
+     * Banker's as the original manager runs it: the pending requests are checked
+     * one at a time in FIFO's order.
+     */
+public:
+    explicit BankersManager(const Program& prog) : BankersEngine(prog, POLICY_BANKERS, "Banker's") {}
+};
+
+
+class BatchedBankersManager : public BankersEngine<BatchedBankersManager> {
+    /*
+     * Banker's deciding on the requests pending in a cycle together, longest waiting
+     * first (see serve). The grants are the same as BankersManager's.
+     */
+    friend class SimulationEngine<BatchedBankersManager>;
+
+public:
+    explicit BatchedBankersManager(const Program& prog)
+            : BankersEngine(prog, POLICY_BATCHED, "batched Banker's") {}
+
+private:
+    // The requests pending in a cycle and their order of priority, the positions in that
+    // order of the requests granted so far, and the units those leave.
+    vector<int> pending, batch, left;
+    vector<pair<long long, int> > order;
+    vector<bool> in_batch;
+
+    void setup() {
+        BankersEngine::setup();
+        int num_tasks = state.task_list.size();
+        pending.reserve(num_tasks);
+        batch.reserve(num_tasks);
+        left.reserve(total_res_list.size());
+        order.reserve(num_tasks);
+        in_batch.assign(num_tasks, false);
+    }
+
+    void serve(const vector<int>& reqs) {
+        /*
+         * Decides on every request pending this cycle, blocked or new, at once. They
+         * are tried longest waiting first (ties keep FIFO's order), and each one is
+         * granted if its units fit in what the requests before it left and the state
+         * with it and every grant before it is safe. Granting more never makes an
+         * unsafe state safe, so rather than one safety check per request, all the
+         * requests that fit are first checked together in a single pass. If that
+         * state is unsafe, the first request to make it so is searched for with
+         * prefixes of growing length, then by bisection, and left waiting, and the
+         * rest are tried again. A request that cannot be granted costs a pass or
+         * two when most of them cannot, and a few when most can.
+         */
+        check_coupling();
+        pending.clear();
+        for (int task_ind = waiting.head; task_ind != -1; task_ind = waiting.next[task_ind]) {
+            pending.emplace_back(task_ind);
+        }
+        pending.insert(pending.end(), reqs.begin(), reqs.end());
+        order.clear();
+        for (int k = 0; k < pending.size(); k++) {
+            order.emplace_back(-state.task_list[pending[k]].curr_wait, k);
+        }
+        sort(order.begin(), order.end());
+
+        batch.clear();
+        left.assign(state.current_res_list.begin(), state.current_res_list.end());
+        int next = 0;
+        bool first_pass = true, base_checked = false;
+        while (next < order.size()) {
+            // Take every request from next on whose units fit.
+            int granted = batch.size();
+            for (; next < order.size(); next++) {
+                int task_ind = pending[order[next].second];
+                if (take_units(task_ind, -1)) {
+                    batch.emplace_back(next);
+                }
+            }
+            if (batch.size() == granted) {
+                break;
+            }
+
+            // The first batch_safe(lo) is true and batch_safe(hi) false, as far as known.
+            int lo = granted, hi = batch.size() + 1;
+            if (first_pass) {
+                first_pass = false;
+                if (batch_safe(batch.size())) {
+                    break;
+                }
+                hi = batch.size();
+            }
+            for (int step = 1; hi - lo > 1; step *= 2) {
+                int probe = min(lo + step, hi - 1);
+                if (!batch_safe(probe)) {
+                    hi = probe;
+                    break;
+                }
+                lo = probe;
+            }
+            if (hi > batch.size()) {
+                break;
+            }
+
+            // If the state is unsafe before any grant (units are on their way back), none can be granted.
+            if (!base_checked and lo == 0) {
+                base_checked = true;
+                if (!batch_safe(0)) {
+                    batch.clear();
+                    break;
+                }
+            }
+
+            // The first request that leaves the state unsafe waits; the ones after it are tried again.
+            while (hi - lo > 1) {
+                int mid = (lo + hi) / 2;
+                if (batch_safe(mid)) {
+                    lo = mid;
                 } else {
-                    // If not, abort.
-                    task_list[ins.task_number - 1].abort();
-                    cout << "Banker aborts task " << ins.task_number << " before run begins:" << endl;
-                    cout << "    claim for resource " << ins.resource_type << " (" << ins.initial_claim << ") ";
-                    cout << "exceeds number of units present (" << total_res_list[ins.resource_type - 1] << ")" << endl;
+                    hi = mid;
+                }
+            }
+            for (int k = lo; k < batch.size(); k++) {
+                take_units(pending[order[batch[k]].second], 1);
+            }
+            next = batch[lo] + 1;
+            batch.resize(lo);
+        }
+
+        // Serve the requests in FIFO's order: the blocked ones keep their place if they wait again.
+        for (int k: batch) {
+            in_batch[pending[order[k].second]] = true;
+        }
+        for (int task_ind: pending) {
+            if (in_batch[task_ind]) {
+                in_batch[task_ind] = false;
+                waiting.remove(task_ind);
+                grant_request(task_ind);
+            } else {
+                state.task_list[task_ind].wait();
+                trace_wait(task_ind);
+                if (!waiting.queued[task_ind]) {
+                    waiting.push_back(task_ind);
+                }
+            }
+        }
+
+        // The grants were not made through the cached sequence, which is left behind.
+        sequence_valid = false;
+    }
+
+    bool take_units(int task_ind, int sign) {
+        /*
+         * Takes the units of a task's request out of those left for the batch (sign
+         * -1), if they all fit, or puts them back (sign 1).
+         */
+        int ind = next_instruction(task_ind);
+        int end = request_end(ind);
+        for (int i = ind; sign < 0 and i < end; i++) {
+            if (left[instr_list.resource_type[i] - 1] < instr_list.amount[i]) {
+                return false;
+            }
+        }
+        for (int i = ind; i < end; i++) {
+            left[instr_list.resource_type[i] - 1] += sign * instr_list.amount[i];
+        }
+        return true;
+    }
+
+    bool batch_safe(int count) {
+        /*
+         * Runs the complete safety algorithm over all live tasks, as if the first
+         * count requests of the batch had been granted.
+         */
+        int num_res = state.num_res;
+        available.assign(state.current_res_list.begin(), state.current_res_list.end());
+        for (int k = 0; k < count; k++) {
+            apply_request(pending[order[batch[k]].second], 1);
+        }
+        gather_live();
+        done.assign(state.task_list.size(), false);
+        bool safe = find_safe_sequence(state.need.data(), state.held.data(), num_res, live_list, available, done,
+                                       sequence);
+        for (int k = 0; k < count; k++) {
+            apply_request(pending[order[batch[k]].second], -1);
+        }
+        return safe;
+    }
+};
+
+
+class SrnfManager : public SimulationEngine<SrnfManager> {
+    /*
+     * An optimistic manager tuned for throughput (smallest remaining need first):
+     * every cycle, the pending requests, blocked or new, are tried in order of the
+     * total units their tasks may still request under their claims, smallest first,
+     * so the tasks closest to finishing get their units and give them back sooner.
+     * Ties keep FIFO's order. Deadlocks are handled as in FIFO.
+     */
+    friend class SimulationEngine<SrnfManager>;
+
+public:
+    explicit SrnfManager(const Program& prog) : SimulationEngine(prog, POLICY_SRNF, "SRNF") {}
+
+private:
+    vector<int> pending;
+    vector<pair<long long, int> > order;
+
+    void setup() {
+        pending.reserve(state.task_list.size());
+        order.reserve(state.task_list.size());
+    }
+
+    void start_cycle() {
+        resolve_deadlock();
+    }
+
+    bool admit(int task_ind) {
+        return units_available(task_ind);
+    }
+
+    long long remaining_need(int task_ind) {
+        // Total units of every type the task may still request.
+        long long total = 0;
+        for (int r = 0; r < state.num_res; r++) {
+            total += state.need[task_ind * state.num_res + r];
+        }
+        return total;
+    }
+
+    void serve(const vector<int>& reqs) {
+        // Line up the blocked tasks and then the new requests, as FIFO would serve them.
+        pending.clear();
+        for (int task_ind = waiting.head; task_ind != -1; task_ind = waiting.next[task_ind]) {
+            pending.emplace_back(task_ind);
+        }
+        pending.insert(pending.end(), reqs.begin(), reqs.end());
+
+        // Sort them by remaining need, keeping that order among equals.
+        order.clear();
+        for (int k = 0; k < pending.size(); k++) {
+            order.emplace_back(remaining_need(pending[k]), k);
+        }
+        sort(order.begin(), order.end());
+
+        for (const pair<long long, int>& entry: order) {
+            int task_ind = pending[entry.second];
+            if (admit(task_ind)) {
+                waiting.remove(task_ind);
+                grant_request(task_ind);
+            } else {
+                state.task_list[task_ind].wait();
+                trace_wait(task_ind);
+                if (!waiting.queued[task_ind]) {
+                    waiting.push_back(task_ind);
                 }
             }
         }
+    }
+};
 
-        // Loop through all the instructions until all resources have been terminated or aborted.
-        bool finished = false;
-        while (!finished) {
-            int t_num = 1;
 
-            // Lists needed to execute 'release's and 'require's.
-            vector<int> released_types;
-            vector<int> released_amounts;
-            vector<int> reqs;
+ResManager* new_manager(const Program& program, Policy policy) {
+    /*
+     * Creates a resource manager running the given policy over a program.
+     */
+    switch (policy) {
+    case POLICY_FIFO:
+        return new FifoManager(program);
+    case POLICY_BANKERS:
+        return new BankersManager(program);
+    case POLICY_BATCHED:
+        return new BatchedBankersManager(program);
+    default:
+        return new SrnfManager(program);
+    }
+}
+
 
-            // Loops through all the tasks identifying the next instruction to be executed for each task.
-            for (Task t: task_list) {
-                if (t.aborted or t.complete) {
-                    t_num++;
+void execute_all(vector<ResManager*>& managers) {
+    /*
+     * Executes every resource manager in its own thread (the last one in the
+     * calling thread) and waits for all of them to finish.
+     */
+    vector<thread> workers;
+    for (int i = 0; i + 1 < managers.size(); i++) {
+        workers.emplace_back(&ResManager::execute, managers[i]);
+    }
+    if (!managers.empty()) {
+        managers.back()->execute();
+    }
+    for (thread& worker: workers) {
+        worker.join();
+    }
+}
+
+
+void append_int(string& out, long long num) {
+    /*
+     * Used for printing. Appends the decimal digits of a number to the output.
+     */
+    char digits[24];
+    int len = 0;
+    unsigned long long value = num < 0 ? 0ULL - num : num;
+    do {
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    if (num < 0) {
+        digits[len++] = '-';
+    }
+    while (len > 0) {
+        out += digits[--len];
+    }
+}
+
+
+void append_spaces(string& out, int count) {
+    // Used for printing. Pads the output with the given number of spaces (if positive).
+    if (count > 0) {
+        out.append(count, ' ');
+    }
+}
+
+
+int wait_percentage(long long time_taken, long long waiting_time) {
+    // Percentage of its time a task spent waiting, as shown next to each task.
+    return int(waiting_time / float(time_taken) * 100);
+}
+
+
+int total_percentage(long long total_time, long long total_wait) {
+    // Percentage of the total time spent waiting, as shown in the totals.
+    return int(total_wait * 100 / float(total_time));
+}
+
+
+long long max_result(const vector<TaskResult>& results) {
+    // Used for printing. Largest time or waiting time of a task that was not aborted, or -1.
+    long long largest = -1;
+    for (const TaskResult& result: results) {
+        if (!result.aborted) {
+            largest = max(largest, max(result.time_taken, result.waiting_time));
+        }
+    }
+    return largest;
+}
+
+
+void append_table_cells(string& out, const TaskResult& result, int maxdigs) {
+    // Used for printing. Appends the time, waiting time and percentage columns of a task.
+    if (result.aborted) {
+        append_spaces(out, maxdigs + 2);
+        out += "aborted";
+        append_spaces(out, (maxdigs + 3) * 2 - 5);
+        return;
+    }
+
+    int perc = wait_percentage(result.time_taken, result.waiting_time);
+    append_spaces(out, maxdigs - num_digs(result.time_taken) + 3);
+    append_int(out, result.time_taken);
+    append_spaces(out, maxdigs - num_digs(result.waiting_time) + 3);
+    append_int(out, result.waiting_time);
+    append_spaces(out, maxdigs + 3 - num_digs(perc));
+    append_int(out, perc);
+    out += '%';
+}
+
+
+void append_table_totals(string& out, const vector<TaskResult>& results, int maxdigs_task, int maxdigs) {
+    // Used for printing. Appends the totals of a run.
+    long long total_time = 0;
+    long long total_wait = 0;
+    for (const TaskResult& result: results) {
+        total_time += result.time_taken;
+        total_wait += result.waiting_time;
+    }
+    int total_perc = total_percentage(total_time, total_wait);
+
+    out += "  Total";
+    append_spaces(out, maxdigs_task);
+    append_spaces(out, maxdigs - num_digs(total_time) + 3);
+    append_int(out, total_time);
+    append_spaces(out, maxdigs - num_digs(total_wait) + 3);
+    append_int(out, total_wait);
+    append_spaces(out, maxdigs + 3 - num_digs(total_perc));
+    append_int(out, total_perc);
+    out += '%';
+}
+
+
+void append_table(string& out, const vector<TaskResult>& fifo, const vector<TaskResult>& bankers) {
+    /*
+     * Appends the required tables to the output, side by side.
+     */
+    out += '\n';
+    int maxdigs_task = num_digs(int(fifo.size()) - 1);
+    int maxdigs_fifo = num_digs(max_result(fifo));
+    int maxdigs_bankers = num_digs(max_result(bankers));
+    int half_fifo = (5 + maxdigs_task + 3 * (3 + maxdigs_fifo) + 1) / 2;
+    int half_bankers = (5 + maxdigs_task + 3 * (3 + maxdigs_bankers) + 1) / 2;
+
+    out += "  ";
+    append_spaces(out, half_fifo - 2);
+    out += "FIFO";
+    append_spaces(out, half_fifo - 2);
+    out += "  ";
+    append_spaces(out, half_bankers - 2);
+    out += "BANKER'S";
+    append_spaces(out, half_bankers - 4);
+    out += '\n';
+
+    for (int i = 0; i < fifo.size(); i++) {
+        int digs_task = num_digs(i + 1);
+
+        out += "  Task ";
+        append_spaces(out, maxdigs_task - digs_task);
+        append_int(out, i + 1);
+        append_table_cells(out, fifo[i], maxdigs_fifo);
+
+        out += "  ";
+
+        out += "  Task ";
+        append_spaces(out, maxdigs_task - digs_task);
+        append_int(out, i + 1);
+        append_table_cells(out, bankers[i], maxdigs_bankers);
+
+        out += '\n';
+    }
+
+    append_table_totals(out, fifo, maxdigs_task, maxdigs_fifo);
+    out += "  ";
+    append_table_totals(out, bankers, maxdigs_task, maxdigs_bankers);
+    out += '\n';
+}
+
+
+void append_csv(string& out, const vector<const char*>& names, const vector<const vector<TaskResult>*>& runs) {
+    /*
+     * Appends one row per task and run, plus one row with the totals of each run.
+     * Aborted tasks have empty time, waiting time and percentage fields.
+     */
+    out += "policy,task,time,wait,wait_pct,aborted\n";
+    for (int run = 0; run < runs.size(); run++) {
+        long long total_time = 0;
+        long long total_wait = 0;
+        int aborted = 0;
+        for (int i = 0; i < runs[run]->size(); i++) {
+            const TaskResult& result = (*runs[run])[i];
+            out += names[run];
+            out += ',';
+            append_int(out, i + 1);
+            if (result.aborted) {
+                out += ",,,,1\n";
+                aborted++;
+                continue;
+            }
+            out += ',';
+            append_int(out, result.time_taken);
+            out += ',';
+            append_int(out, result.waiting_time);
+            out += ',';
+            append_int(out, result.time_taken == 0 ? 0 : wait_percentage(result.time_taken, result.waiting_time));
+            out += ",0\n";
+            total_time += result.time_taken;
+            total_wait += result.waiting_time;
+        }
+
+        out += names[run];
+        out += ",total,";
+        append_int(out, total_time);
+        out += ',';
+        append_int(out, total_wait);
+        out += ',';
+        append_int(out, total_time == 0 ? 0 : total_percentage(total_time, total_wait));
+        out += ',';
+        append_int(out, aborted);
+        out += '\n';
+    }
+}
+
+
+void append_json(string& out, const vector<const char*>& names, const vector<const vector<TaskResult>*>& runs) {
+    /*
+     * Appends the results of every run as a JSON object. Aborted tasks have null
+     * time, waiting time and percentage.
+     */
+    out += "{\"policies\":[";
+    for (int run = 0; run < runs.size(); run++) {
+        long long total_time = 0;
+        long long total_wait = 0;
+        int aborted = 0;
+        out += run == 0 ? "\n" : ",\n";
+        out += "{\"name\":\"";
+        out += names[run];
+        out += "\",\"tasks\":[";
+        for (int i = 0; i < runs[run]->size(); i++) {
+            const TaskResult& result = (*runs[run])[i];
+            out += i == 0 ? "\n" : ",\n";
+            out += "{\"task\":";
+            append_int(out, i + 1);
+            if (result.aborted) {
+                out += ",\"time\":null,\"wait\":null,\"wait_pct\":null,\"aborted\":true}";
+                aborted++;
+                continue;
+            }
+            out += ",\"time\":";
+            append_int(out, result.time_taken);
+            out += ",\"wait\":";
+            append_int(out, result.waiting_time);
+            out += ",\"wait_pct\":";
+            append_int(out, result.time_taken == 0 ? 0 : wait_percentage(result.time_taken, result.waiting_time));
+            out += ",\"aborted\":false}";
+            total_time += result.time_taken;
+            total_wait += result.waiting_time;
+        }
+
+        out += "],\n\"total\":{\"time\":";
+        append_int(out, total_time);
+        out += ",\"wait\":";
+        append_int(out, total_wait);
+        out += ",\"wait_pct\":";
+        append_int(out, total_time == 0 ? 0 : total_percentage(total_time, total_wait));
+        out += ",\"aborted\":";
+        append_int(out, aborted);
+        out += "}}";
+    }
+    out += "\n]}\n";
+}
+
+
+class WorkStealingPool {
+    /*
+     * Runs a fixed number of jobs on a set of worker threads. The jobs are dealt
+     * out to the workers' own queues up front; a worker takes jobs from the back
+     * of its own queue and, once it runs out, steals from the front of the
+     * others', so that workers that drew short jobs help the ones that did not.
+     */
+public:
+    int num_workers;
+
+    explicit WorkStealingPool(int workers) {
+        num_workers = max(workers, 1);
+    }
+
+    void run(int num_jobs, const function<void(int)>& job) {
+        queues = vector<deque<int> >(num_workers);
+        locks = vector<mutex>(num_workers);
+        for (int i = 0; i < num_jobs; i++) {
+            queues[i % num_workers].push_back(i);
+        }
+
+        vector<thread> workers;
+        for (int w = 1; w < num_workers; w++) {
+            workers.emplace_back(&WorkStealingPool::work, this, w, cref(job));
+        }
+        work(0, job);
+        for (thread& worker: workers) {
+            worker.join();
+        }
+    }
+
+private:
+    vector<deque<int> > queues;
+    vector<mutex> locks;
+
+    void work(int self, const function<void(int)>& job) {
+        int next;
+        while (take(self, next)) {
+            job(next);
+        }
+    }
+
+    bool take(int self, int& next) {
+        // Takes the next job from the worker's own queue, or steals one.
+        {
+            lock_guard<mutex> guard(locks[self]);
+            if (!queues[self].empty()) {
+                next = queues[self].back();
+                queues[self].pop_back();
+                return true;
+            }
+        }
+        for (int i = 1; i < num_workers; i++) {
+            int victim = (self + i) % num_workers;
+            lock_guard<mutex> guard(locks[victim]);
+            if (!queues[victim].empty()) {
+                next = queues[victim].front();
+                queues[victim].pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+
+class DisjointSets {
+    /*
+     * Union-find over a range of numbers, with path halving and union by size.
+     */
+public:
+    vector<int> parent, size;
+
+    explicit DisjointSets(int n) : parent(n), size(n, 1) {
+        iota(parent.begin(), parent.end(), 0);
+    }
+
+    int find(int x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    }
+
+    void unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) return;
+        if (size[a] < size[b]) swap(a, b);
+        parent[b] = a;
+        size[a] += size[b];
+    }
+};
+
+
+class Partition {
+    /*
+     * A program split into connected components: two tasks are in the same one if
+     * their instructions name a common resource type, directly or through other
+     * tasks. Tasks of different components never compete for units, so each
+     * component is a program of its own, with its tasks and resource types
+     * numbered from 1 in their original order.
+     */
+public:
+    vector<Program> programs;
+    vector<vector<int> > tasks;
+
+    void build(const Program& program) {
+        int num_res = program.total_res_list.size();
+        const InstructionList& instr_list = program.instr_list;
+
+        // Join the resource types every task names (0 names none).
+        DisjointSets sets(num_res + 1);
+        vector<int> first_res(program.num_tasks, 0);
+        for (int t = 0; t < program.num_tasks; t++) {
+            for (int i = program.task_start[t]; i < program.task_start[t + 1]; i++) {
+                int res = instr_list.resource_type[i];
+                if (res == 0) {
                     continue;
+                } else if (first_res[t] == 0) {
+                    first_res[t] = res;
+                } else {
+                    sets.unite(first_res[t], res);
                 }
-                int i_num = 0;
-                int ins_ind = 0;
-                for (Instruction ins: instr_list) {
-                    if (ins.task_number == t_num) {
-                        if (i_num == t.curr_instr) {
-                            break;
-                        }
-                        i_num++;
+            }
+        }
+
+        // Number the components in order of their first task.
+        vector<int> component_of_set(num_res + 1, -1), component_of(program.num_tasks), local_task(program.num_tasks);
+        for (int t = 0; t < program.num_tasks; t++) {
+            int root = first_res[t] == 0 ? -1 : sets.find(first_res[t]);
+            if (root == -1 or component_of_set[root] == -1) {
+                if (root != -1) {
+                    component_of_set[root] = tasks.size();
+                }
+                tasks.emplace_back();
+            }
+            component_of[t] = root == -1 ? tasks.size() - 1 : component_of_set[root];
+            local_task[t] = tasks[component_of[t]].size();
+            tasks[component_of[t]].emplace_back(t);
+        }
+
+        // Give every component the resource types its tasks name. Types no task names are left out.
+        programs.resize(tasks.size());
+        vector<int> local_res(num_res + 1, 0);
+        for (int r = 1; r <= num_res; r++) {
+            int component = component_of_set[sets.find(r)];
+            if (component != -1) {
+                programs[component].total_res_list.emplace_back(program.total_res_list[r - 1]);
+                local_res[r] = programs[component].total_res_list.size();
+            }
+        }
+
+        // Copy every task's instructions to its component.
+        for (int c = 0; c < tasks.size(); c++) {
+            Program& part = programs[c];
+            part.num_tasks = tasks[c].size();
+            part.task_start.assign(1, 0);
+            for (int t: tasks[c]) {
+                part.task_start.emplace_back(part.task_start.back() + program.task_start[t + 1] - program.task_start[t]);
+            }
+            part.instr_list.resize(part.task_start.back());
+        }
+        for (int t = 0; t < program.num_tasks; t++) {
+            Program& part = programs[component_of[t]];
+            int ind = part.task_start[local_task[t]];
+            for (int i = program.task_start[t]; i < program.task_start[t + 1]; i++, ind++) {
+                part.instr_list.set(ind, instr_list.opcode[i], instr_list.delay[i],
+                                    local_res[instr_list.resource_type[i]], instr_list.amount[i]);
+            }
+        }
+
+        // Initiates keep their order of appearance.
+        for (int ind: program.initiate_list) {
+            int t = program.task_of(ind);
+            Program& part = programs[component_of[t]];
+            part.initiate_list.emplace_back(part.task_start[local_task[t]] + ind - program.task_start[t]);
+        }
+    }
+
+    string describe() const {
+        /*
+         * How much parallelism the program exposes: the number of components and
+         * the tasks and resource types of the largest ones.
+         */
+        vector<int> sizes;
+        int largest_res = 0;
+        for (int c = 0; c < programs.size(); c++) {
+            sizes.emplace_back(tasks[c].size());
+            largest_res = max(largest_res, int(programs[c].total_res_list.size()));
+        }
+        sort(sizes.begin(), sizes.end());
+
+        ostringstream out;
+        out << "components=" << sizes.size();
+        out << " largest_tasks=" << (sizes.empty() ? 0 : sizes.back());
+        out << " median_tasks=" << (sizes.empty() ? 0 : sizes[sizes.size() / 2]);
+        out << " largest_resources=" << largest_res;
+        return out.str();
+    }
+};
+
+
+class ShardedManager : public ResManager {
+    /*
+     * Runs a policy over every component of a partition, spread over all the
+     * cores, and puts the tasks back together. Components never compete for
+     * units, so every task ends up exactly as in a run over the whole program,
+     * unless a component was coupled to the others: a Banker's component that was
+     * unsafe while units were on their way back holds back every other one for
+     * that cycle. Messages are not the same either: they number tasks and
+     * resource types within the component, a Banker's abort counts the units
+     * released in the whole program, and FIFO only finds a deadlock once every
+     * component is stuck. If any component was coupled or has something to
+     * report, the policy runs again over the whole program instead.
+     */
+public:
+    const Partition& partition;
+    bool unsharded;
+
+    ShardedManager(const Program& prog, Policy pol, const Partition& part)
+            : ResManager(prog, pol, POLICY_TRACE_NAMES[pol]), partition(part) {
+        unsharded = false;
+    }
+
+protected:
+    void run() {
+        // A single component is the whole program.
+        unsharded = partition.programs.size() < 2;
+        if (!unsharded) {
+            vector<unique_ptr<ResManager> > parts(partition.programs.size());
+            WorkStealingPool pool(thread::hardware_concurrency());
+            pool.run(parts.size(), [this, &parts](int c) {
+                parts[c].reset(new_manager(partition.programs[c], policy));
+                parts[c]->track_coupling = true;
+                parts[c]->victim_policy = victim_policy;
+                parts[c]->explain_aborts = explain_aborts;
+                parts[c]->execute();
+            });
+
+            for (const unique_ptr<ResManager>& part: parts) {
+                if (part->messages.size() > 0 or part->coupled) {
+                    unsharded = true;
+                }
+            }
+            if (!unsharded) {
+                for (int c = 0; c < parts.size(); c++) {
+                    for (int k = 0; k < partition.tasks[c].size(); k++) {
+                        state.task_list[partition.tasks[c][k]] = parts[c]->tasks()[k];
                     }
-                    ins_ind++;
-                }
-
-                // Only execute instructions whose delay is equal to zero.
-                if (instr_list[ins_ind].delay == 0) {
-                    // If the next instruction is a request:
-                    if (instr_list[ins_ind].type == "request") {
-                        int ind = 0;
-                        for (int rt: t.resource_types) {
-                            if (rt == instr_list[ins_ind].resource_type) {
-                                break;
-                            }
-                            ind++;
-                        }
-                        int available = t.initial_claims[ind] - t.resources_held[ind];
-                        // Check whether it's a valid one.
-                        if (instr_list[ins_ind].number_requested <= available) {
-                            reqs.emplace_back(ins_ind);
-
-                        // If not, abort.
-                        } else {
-                            task_list[t_num - 1].abort();
-                            for (int i = 0; i < task_list[t_num - 1].resource_types.size(); i++) {
-                                released_types.emplace_back(task_list[t_num - 1].resource_types[i]);
-                                released_amounts.emplace_back(task_list[t_num - 1].resources_held[i]);
-                                cout << "During cycles " << cycle << "-" << cycle + 1 << " of Banker's algorithms";
-                                cout << endl << "    Task " << t_num << "'s request exceeds its claim; aborted; ";
-                                cout << accumulate(released_amounts.begin(), released_amounts.end(), 0);
-                                cout << " units available next cycle" << endl;
-                            }
-                        }
+                }
+                return;
+            }
+        }
 
-                    // If it's a release, add to the release lists and release from task.
-                    } else if (instr_list[ins_ind].type == "release") {
-                        task_list[t_num - 1].release(instr_list[ins_ind].resource_type,
-                                                     instr_list[ins_ind].number_released);
-                        released_types.emplace_back(instr_list[ins_ind].resource_type);
-                        released_amounts.emplace_back(instr_list[ins_ind].number_released);
+        unique_ptr<ResManager> whole(new_manager(program, policy));
+        whole->victim_policy = victim_policy;
+        whole->explain_aborts = explain_aborts;
+        whole->execute();
+        messages << whole->messages.str();
+        state.task_list = whole->tasks();
+    }
+};
+
+
+string summarize(const vector<TaskResult>& results) {
+    /*
+     * Used for batch mode. Returns the total time, total waiting time, waiting
+     * percentage and number of aborted tasks of a run, separated by spaces.
+     */
+    long long total_time = 0;
+    long long total_wait = 0;
+    int aborted = 0;
+    for (const TaskResult& result: results) {
+        total_time += result.time_taken;
+        total_wait += result.waiting_time;
+        aborted += result.aborted;
+    }
+
+    ostringstream out;
+    out << total_time << " " << total_wait << " ";
+    out << (total_time == 0 ? 0 : int(total_wait * 100 / float(total_time))) << "% " << aborted;
+    return out.str();
+}
+
+
+vector<string> list_inputs(const vector<string>& paths) {
+    /*
+     * Used for batch mode. Expands every directory among the given paths into
+     * the files it contains, sorted by name.
+     */
+    vector<string> files;
+    for (const string& path: paths) {
+        DIR* dir = opendir(path.c_str());
+        if (dir == NULL) {
+            files.emplace_back(path);
+            continue;
+        }
+
+        vector<string> entries;
+        for (dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+            string name = entry->d_name;
+            string full = path + (path.back() == '/' ? "" : "/") + name;
+            struct stat st;
+            if (stat(full.c_str(), &st) == 0 and S_ISREG(st.st_mode)) {
+                entries.emplace_back(full);
+            }
+        }
+        closedir(dir);
+
+        sort(entries.begin(), entries.end());
+        files.insert(files.end(), entries.begin(), entries.end());
+    }
+    return files;
+}
+
+
+int run_batch(const vector<string>& paths) {
+    /*
+     * Compares FIFO and Banker's on every input file, spreading the files over
+     * all the cores of the machine. Prints one row per file, in the order the
+     * files were given, and the number of files processed per second.
+     */
+    vector<string> files = list_inputs(paths);
+    vector<string> rows(files.size());
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    WorkStealingPool pool(thread::hardware_concurrency());
+    pool.run(files.size(), [&files, &rows](int i) {
+        InputFile input;
+        Program program;
+        if (!input.open(files[i]) or !program.load(input)) {
+            rows[i] = files[i] + " invalid (" + input.error + ")";
+            return;
+        }
+
+        // Each file already has a thread of its own, so both algorithms run in it.
+        FifoManager fifo(program);
+        BankersManager bankers(program);
+        fifo.execute();
+        bankers.execute();
+        rows[i] = files[i] + " " + summarize(fifo.results) + " " + summarize(bankers.results);
+    });
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "file fifo_time fifo_wait fifo_wait_pct fifo_aborted ";
+    cout << "bankers_time bankers_wait bankers_wait_pct bankers_aborted" << endl;
+    for (const string& row: rows) {
+        cout << row << "\n";
+    }
+    cout.flush();
+
+    cerr << files.size() << " files in " << seconds << " s (";
+    cerr << (seconds > 0 ? files.size() / seconds : 0) << " files/s, ";
+    cerr << pool.num_workers << " threads)" << endl;
+    return 0;
+}
+
+
+int compile(const string& in_path, const string& out_path) {
+    /*
+     * Converts an input file to a compiled one, which later runs load without
+     * parsing (a compiled input can be given wherever a text one can).
+     */
+    InputFile input;
+    Program program;
+    if (!input.open(in_path) or !program.load(input)) {
+        cerr << "Invalid input file given (" << input.error << ")." << endl;
+        return 2;
+    }
+
+    ofstream out(out_path.c_str(), ios::binary);
+    program.write_compiled(out);
+    out.close();
+    if (!out.good()) {
+        cerr << "Cannot write the compiled file." << endl;
+        return 2;
+    }
+    return 0;
+}
+
+
+enum Decision : unsigned char {
+    /*
+     * The answer of the admission controller to a message about a task.
+     */
+    DECISION_GRANT,
+    DECISION_WAIT,
+    DECISION_ABORT,
+    DECISION_OK,
+    DECISION_ERROR
+};
+
+
+class AdmissionController {
+    /*
+     * Banker's algorithm as a live admission controller, used by the server mode.
+     * Tasks come and go while it runs, each identified by a number its client
+     * picks: a task claims units, then requests and releases them, and every request
+     * is answered with the checks of the simulation (see bankers_check): abort if it
+     * exceeds the task's claim, grant if the units are there and the state after
+     * granting is safe, wait otherwise. There are no cycles, so released units are
+     * available at once, and the waiting requests are retried every time units come
+     * back. Each task lives in a slot, its row of the claims, held and need matrices.
+     */
+public:
+    int num_res;
+    vector<int> total_res_list, current_res_list;
+    vector<int> claims, held, need;
+    vector<Task> task_list;
+    vector<int> task_id, owner, pending_res, pending_amount;
+    unordered_map<int, int> slot_of;
+    vector<int> free_slots;
+
+    // The requests that cannot be granted yet. Every retry counts as a wait of every
+    // request still blocked, and new ones join at the back, so the queue is always in
+    // order of curr_wait, longest first.
+    WaitQueue waiting;
+
+    // The live tasks, in the order of the last safe sequence found: most of the time
+    // the next check finds the same sequence in a single pass.
+    vector<int> order;
+
+    // Slots whose waiting request was granted by the last retry, for their owners to be told.
+    vector<int> granted;
+
+    explicit AdmissionController(const vector<int>& units) : total_res_list(units), current_res_list(units) {
+        num_res = units.size();
+        waiting.reset(0);
+    }
+
+    Decision initiate(int id, int owner_fd, int res_type, int claim, string& error) {
+        /*
+         * Sets the claim of a task for a resource type, creating the task the first
+         * time. A task that already holds units or is waiting cannot claim more,
+         * as the state might no longer be safe. Task numbers cannot be negative.
+         */
+        if (id < 0) {
+            error = "invalid task";
+            return DECISION_ERROR;
+        } else if (res_type < 1 or res_type > num_res or claim < 0) {
+            error = "invalid resource or claim";
+            return DECISION_ERROR;
+        }
+        unordered_map<int, int>::iterator it = slot_of.find(id);
+        int slot = it == slot_of.end() ? -1 : it->second;
+        if (slot != -1 and owner[slot] != owner_fd) {
+            error = "task belongs to another client";
+            return DECISION_ERROR;
+        }
+        if (slot != -1 and waiting.queued[slot]) {
+            error = "task is waiting";
+            return DECISION_ERROR;
+        }
+        if (slot != -1 and accumulate(held.begin() + slot * num_res, held.begin() + (slot + 1) * num_res, 0) > 0) {
+            error = "task already holds units";
+            return DECISION_ERROR;
+        }
+        if (slot == -1) {
+            slot = new_slot(id, owner_fd);
+        }
 
-                    // If next instruction is a terminate, terminate the task.
-                    } else if (instr_list[ins_ind].type == "terminate") {
-                        task_list[t_num - 1].terminate();
-                    }
+        // Check whether the claim is valid. If not, abort.
+        if (claim > total_res_list[res_type - 1]) {
+            abort(slot);
+            return DECISION_ABORT;
+        }
 
-                // If the delay is not zero, delay the task and decrease the delay in the instruction.
-                } else {
-                    instr_list[ins_ind].delay--;
-                    task_list[t_num - 1].delay();
-                }
+        // A task holding nothing can always finish last, once every other task is done.
+        int cell = slot * num_res + res_type - 1;
+        claims[cell] = claim;
+        need[cell] = claim;
+        order.erase(find(order.begin(), order.end(), slot));
+        order.emplace_back(slot);
+        task_list[slot].initiate();
+        return DECISION_OK;
+    }
 
-                t_num++;
-            }
+    Decision request(int id, int owner_fd, int res_type, int amount, string& error) {
+        /*
+         * A task asks for units: grants them, queues the request or aborts the task.
+         */
+        int slot = find_task(id, owner_fd, res_type, amount, error);
+        if (slot == -1) {
+            return DECISION_ERROR;
+        }
 
-            // Create a list of sorted indices for the 'require' instructions this round.
-            vector<int> sorted_reqs;
-            vector<int> used_indices;
-            for (int i = 0; i < reqs.size(); i++) {
-                int max_prio = -1;
-                int max_ind = 0;
-                for (int j = 0; j < reqs.size(); j++) {
-                    Task t = task_list[instr_list[reqs[j]].task_number - 1];
-                    if (t.curr_wait > max_prio and
-                            find(used_indices.begin(), used_indices.end(), j) == used_indices.end()) {
-                        max_prio = t.curr_wait;
-                        max_ind = j;
-                    }
-                }
-                sorted_reqs.emplace_back(reqs[max_ind]);
-                used_indices.emplace_back(max_ind);
-            }
+        // Check whether it's a valid one. If not, abort.
+        if (amount > need[slot * num_res + res_type - 1]) {
+            abort(slot);
+            return DECISION_ABORT;
+        }
 
-            // Go through the tasks that have requested this cycle and execute them when possible,
-            // in order of priority.
-            for (int ind: sorted_reqs) {
+        if (try_grant(slot, res_type - 1, amount)) {
+            task_list[slot].granted();
+            return DECISION_GRANT;
+        }
+        pending_res[slot] = res_type - 1;
+        pending_amount[slot] = amount;
+        task_list[slot].wait();
+        waiting.push_back(slot);
+        return DECISION_WAIT;
+    }
 
-                // Only execute when safe.
-                bool safe = bankers_check(ind);
-                if (safe) {
-                    task_list[instr_list[ind].task_number - 1].granted(instr_list[ind].resource_type,
-                                                 instr_list[ind].number_requested);
-                    current_res_list[instr_list[ind].resource_type - 1] -= instr_list[ind].number_requested;
-                } else {
-                    task_list[instr_list[ind].task_number - 1].wait();
-                }
-            }
+    Decision release(int id, int owner_fd, int res_type, int amount, string& error) {
+        /*
+         * A task gives units back; the waiting requests may now be granted.
+         */
+        int slot = find_task(id, owner_fd, res_type, amount, error);
+        if (slot == -1) {
+            return DECISION_ERROR;
+        }
+        int cell = slot * num_res + res_type - 1;
+        if (amount > held[cell]) {
+            error = "task does not hold that many units";
+            return DECISION_ERROR;
+        }
 
-            // Add the released resources back to the manager at the end of the cycle.
-            for (int i = 0; i < released_types.size(); i++) {
-                current_res_list[released_types[i] - 1] += released_amounts[i];
-            }
+        held[cell] -= amount;
+        need[cell] += amount;
+        current_res_list[res_type - 1] += amount;
+        task_list[slot].release();
+        retry();
+        return DECISION_OK;
+    }
 
-            // If all tasks are completed or aborted, end.
-            finished = true;
-            for (Task t: task_list) {
-                if (t.aborted) {
-                    continue;
-                }
-                if (!t.complete) {
-                    finished = false;
-                }
-            }
-            cycle++;
+    Decision terminate(int id, int owner_fd, string& error) {
+        /*
+         * A task is done. Whatever it still holds goes back to the manager.
+         */
+        int slot = find_task(id, owner_fd, 1, 0, error);
+        if (slot == -1) {
+            return DECISION_ERROR;
         }
+        task_list[slot].terminate();
+        free_slot(slot);
+        retry();
+        return DECISION_OK;
     }
 
-    bool bankers_check(int ind) {
+    void disconnect(int owner_fd) {
         /*
-         * Checks whether the current task requesting resources is allowed to
-         * according to Banker's algorithm.
+         * A client went away: aborts every task it still had.
          */
-        int task_ind = instr_list[ind].task_number - 1;
-        for (int i = 0; i < task_list[task_ind].initial_claims.size(); i++) {
-            int res_ind = task_list[task_ind].resource_types[i] - 1;
-            if (current_res_list[res_ind] < task_list[task_ind].initial_claims[i]
-                                            - task_list[task_ind].resources_held[i]) {
-                return false;
+        for (int slot = 0; slot < task_list.size(); slot++) {
+            if (task_id[slot] != -1 and owner[slot] == owner_fd) {
+                abort(slot);
             }
         }
-        return true;
     }
 
-    vector<int> gather_results() {
+private:
+    // Scratch buffers of the safety algorithm.
+    vector<int> available, sequence;
+    vector<bool> done;
+
+    int new_slot(int id, int owner_fd) {
+        // Finds a free slot for a new task, adding one if there is none.
+        int slot;
+        if (free_slots.empty()) {
+            slot = task_list.size();
+            task_list.emplace_back();
+            task_id.emplace_back(id);
+            owner.emplace_back(owner_fd);
+            pending_res.emplace_back(0);
+            pending_amount.emplace_back(0);
+            claims.resize(claims.size() + num_res, 0);
+            held.resize(held.size() + num_res, 0);
+            need.resize(need.size() + num_res, 0);
+            waiting.grow(task_list.size());
+        } else {
+            slot = free_slots.back();
+            free_slots.pop_back();
+            task_list[slot] = Task();
+            task_id[slot] = id;
+            owner[slot] = owner_fd;
+        }
+        slot_of[id] = slot;
+        order.emplace_back(slot);
+        return slot;
+    }
+
+    void free_slot(int slot) {
+        // Takes a task out, giving back everything it holds.
+        for (int r = 0; r < num_res; r++) {
+            current_res_list[r] += held[slot * num_res + r];
+            claims[slot * num_res + r] = 0;
+            held[slot * num_res + r] = 0;
+            need[slot * num_res + r] = 0;
+        }
+        waiting.remove(slot);
+        order.erase(find(order.begin(), order.end(), slot));
+        slot_of.erase(task_id[slot]);
+        task_id[slot] = -1;
+        free_slots.emplace_back(slot);
+    }
+
+    void abort(int slot) {
+        task_list[slot].abort();
+        free_slot(slot);
+        retry();
+    }
+
+    int find_task(int id, int owner_fd, int res_type, int amount, string& error) {
         /*
-         * Puts the relevant results to be printed in a single one-dimensional vector.
+         * Returns the slot of a task that can send a request, release or terminate,
+         * or -1 (with the reason in error) if the message is not valid.
          */
-        vector<int> results;
-        for (Task t: task_list) {
-            results.emplace_back(t.time_taken);
-            results.emplace_back(t.waiting_time);
+        unordered_map<int, int>::iterator it = slot_of.find(id);
+        if (it == slot_of.end()) {
+            error = "unknown task";
+            return -1;
         }
-        return results;
+        int slot = it->second;
+        if (owner[slot] != owner_fd) {
+            error = "task belongs to another client";
+            return -1;
+        } else if (res_type < 1 or res_type > num_res or amount < 0) {
+            error = "invalid resource or amount";
+            return -1;
+        } else if (waiting.queued[slot]) {
+            error = "task is waiting";
+            return -1;
+        }
+        return slot;
     }
 
-    void print(vector<int> fifo, vector<int> bankers) {
+    bool try_grant(int slot, int res_ind, int amount) {
         /*
-         * Displays the required tables on the screen.
+         * Grants a request if the units are there and the state after the grant is
+         * safe, keeping the safe sequence found.
          */
+        if (current_res_list[res_ind] < amount) {
+            return false;
+        }
+
+        // Apply the grant, then undo it if the state is not safe.
+        int cell = slot * num_res + res_ind;
+        held[cell] += amount;
+        need[cell] -= amount;
+        available.assign(current_res_list.begin(), current_res_list.end());
+        available[res_ind] -= amount;
+        done.resize(task_list.size());
+        if (!find_safe_sequence(need.data(), held.data(), num_res, order, available, done, sequence)) {
+            held[cell] -= amount;
+            need[cell] += amount;
+            return false;
+        }
+
+        current_res_list[res_ind] -= amount;
+        order.swap(sequence);
+        return true;
+    }
+
+    void retry() {
+        // Units came back: grants the waiting requests that can now be, longest wait first.
+        for (int slot = waiting.head; slot != -1; ) {
+            int next = waiting.next[slot];
+            if (try_grant(slot, pending_res[slot], pending_amount[slot])) {
+                waiting.remove(slot);
+                task_list[slot].granted();
+                granted.emplace_back(slot);
+            } else {
+                task_list[slot].wait();
+            }
+            slot = next;
+        }
+    }
+};
 
-        cout << endl;
-        int maxdigs_task = num_digs(task_list.size() - 1);
-        int maxdigs_fifo = num_digs(*max_element(fifo.begin(), fifo.end()));
-        int maxdigs_bankers = num_digs(*max_element(bankers.begin(), bankers.end()));
 
-        cout << "  ";
-        for (int i = 0; i < ((5 + maxdigs_task + 3 * (3 + maxdigs_fifo) + 1) / 2) - 2; i++) {
-            cout << " ";
+class LatencyHistogram {
+    /*
+     * Counts latencies in nanoseconds in buckets an eighth of a power of two wide,
+     * so that percentiles are within 12.5% of the exact value in constant memory,
+     * however many decisions are recorded.
+     */
+public:
+    long long count;
+    vector<long long> buckets;
+
+    LatencyHistogram() : count(0), buckets(64 * 8, 0) {}
+
+    void record(long long ns) {
+        buckets[bucket_of(max(ns, 1LL))]++;
+        count++;
+    }
+
+    double percentile(int p) {
+        // Returns the upper bound, in microseconds, of the bucket holding the p-th percentile.
+        long long rank = max(1LL, (count * p + 99) / 100);
+        long long seen = 0;
+        for (int b = 0; b < buckets.size(); b++) {
+            seen += buckets[b];
+            if (seen >= rank) {
+                return upper_bound_of(b) / 1000.0;
+            }
         }
-        cout << "FIFO";
-        for (int i = 0; i < ((5 + maxdigs_task + 3 * (3 + maxdigs_fifo) + 1) / 2) - 2; i++) {
-            cout << " ";
+        return 0;
+    }
+
+private:
+    static int bucket_of(long long ns) {
+        // Latencies under 8 ns have a bucket each; then 8 per power of two.
+        int exp = 63 - __builtin_clzll(ns);
+        if (exp < 3) {
+            return ns;
+        }
+        return exp * 8 + ((ns >> (exp - 3)) & 7);
+    }
+
+    static long long upper_bound_of(int bucket) {
+        if (bucket < 8) {
+            return bucket;
+        }
+        int exp = bucket / 8;
+        return ((8LL + bucket % 8 + 1) << (exp - 3)) - 1;
+    }
+};
+
+
+volatile sig_atomic_t stop_serving = 0;
+
+void request_stop(int) {
+    stop_serving = 1;
+}
+
+
+class AdmissionServer {
+    /*
+     * Serves an AdmissionController over a Unix domain socket. Clients send one
+     * message per line, in the words of the input files without the delay:
+     *     initiate <task> <resource> <claim>
+     *     request <task> <resource> <units>
+     *     release <task> <resource> <units>
+     *     terminate <task>
+     *     stats
+     * and get one line back per message: "grant <task>", "wait <task>", "abort
+     * <task>", "ok <task>", "error <reason>" or, for stats, the decision latency
+     * percentiles. When a waiting request is granted later on, its client gets a
+     * "grant <task>" line then. A client that disconnects aborts its tasks.
+     *
+     * All clients are served by a single thread with epoll. Everything a client
+     * sent is read at once and all the replies to it are written at once, after
+     * every ready client has been served.
+     */
+public:
+    AdmissionController controller;
+    LatencyHistogram latency;
+
+    explicit AdmissionServer(const vector<int>& units) : controller(units) {
+        listen_fd = -1;
+        epoll_fd = -1;
+    }
+
+    ~AdmissionServer() {
+        for (unordered_map<int, Connection>::iterator it = connections.begin(); it != connections.end(); ++it) {
+            close(it->first);
         }
-        cout << "  ";
-        for (int i = 0; i < ((5 + maxdigs_task + 3 * (3 + maxdigs_bankers) + 1) / 2) - 2; i++) {
-            cout << " ";
+        if (listen_fd != -1) {
+            close(listen_fd);
+            unlink(path.c_str());
         }
-        cout << "BANKER'S";
-        for (int i = 0; i < ((5 + maxdigs_task + 3 * (3 + maxdigs_bankers) + 1) / 2) - 4; i++) {
-            cout << " ";
+        if (epoll_fd != -1) {
+            close(epoll_fd);
         }
-        cout << endl;
-        for (int i = 0; i < fifo.size(); i += 2) {
-            int digs_task = num_digs((i / 2) + 1);
-            int digs_1 = num_digs(fifo[i]);
-            int digs_2 = num_digs(fifo[i + 1]);
-            int digs_3 = num_digs(bankers[i]);
-            int digs_4 = num_digs(bankers[i + 1]);
+    }
 
-            cout << "  Task ";
-            for (int j = 0; j < maxdigs_task - digs_task; j++) {
-                cout << " ";
-            }
-            cout << (i / 2) + 1;
+    bool open(const string& socket_path) {
+        /*
+         * Starts listening on the given path. Returns false if it cannot.
+         */
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            return false;
+        }
+        strcpy(address.sun_path, socket_path.c_str());
 
-            if (fifo[i] == -1) {
-                for (int j = 0; j < maxdigs_fifo + 2; j++) {
-                    cout << " ";
-                }
-                cout << "aborted";
-                for (int j = 0; j < (maxdigs_fifo + 3) * 2 - 5; j++) {
-                    cout << " ";
-                }
-                fifo[i] = 0;
-                fifo[i + 1] = 0;
-            } else {
-                for (int j = 0; j < maxdigs_fifo - digs_1 + 3; j++) {
-                    cout << " ";
-                }
-                cout << fifo[i];
-                for (int j = 0; j < maxdigs_fifo - digs_2 + 3; j++) {
-                    cout << " ";
-                }
-                cout << fifo[i + 1];
-                for (int j = 0; j < maxdigs_fifo + 3 - num_digs(int(fifo[i + 1] / float(fifo[i]) * 100)); j++) {
-                    cout << " ";
-                }
-                cout << int(fifo[i + 1] / float(fifo[i]) * 100) << "%";
-            }
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (listen_fd == -1) {
+            return false;
+        }
+        unlink(socket_path.c_str());
+        if (bind(listen_fd, (sockaddr*) &address, sizeof(address)) == -1 or listen(listen_fd, SOMAXCONN) == -1) {
+            close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        path = socket_path;
 
-            cout << "  ";
+        epoll_fd = epoll_create1(0);
+        return epoll_fd != -1 and watch(listen_fd, EPOLL_CTL_ADD, EPOLLIN);
+    }
 
-            cout << "  Task ";
-            for (int j = 0; j < maxdigs_task - digs_task; j++) {
-                cout << " ";
+    void run() {
+        /*
+         * Serves clients until SIGINT or SIGTERM.
+         */
+        epoll_event events[64];
+        while (!stop_serving) {
+            int ready = epoll_wait(epoll_fd, events, 64, -1);
+            if (ready == -1) {
+                continue;
             }
-            cout << (i / 2) + 1;
 
-            if (bankers[i] == -1) {
-                for (int j = 0; j < maxdigs_bankers + 2; j++) {
-                    cout << " ";
-                }
-                cout << "aborted";
-                for (int j = 0; j < (maxdigs_bankers + 3) * 2 - 5; j++) {
-                    cout << " ";
-                }
-                bankers[i] = 0;
-                bankers[i + 1] = 0;
-            } else {
-                for (int j = 0; j < maxdigs_bankers - digs_3 + 3; j++) {
-                    cout << " ";
+            for (int i = 0; i < ready; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listen_fd) {
+                    accept_clients();
+                    continue;
                 }
-                cout << bankers[i];
-                for (int j = 0; j < maxdigs_bankers - digs_4 + 3; j++) {
-                    cout << " ";
+                if (events[i].events & EPOLLOUT) {
+                    flush(fd);
                 }
-                cout << bankers[i + 1];
-                for (int j = 0;
-                     j < maxdigs_bankers + 3 - num_digs(int(bankers[i + 1] / float(bankers[i]) * 100)); j++) {
-                    cout << " ";
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    serve(fd);
                 }
-                cout << int(bankers[i + 1] / float(bankers[i]) * 100) << "%";
             }
 
-            cout << endl;
+            // Write out the replies of the whole batch, one write per client.
+            for (int fd: dirty) {
+                flush(fd);
+            }
+            dirty.clear();
         }
+    }
+
+    string stats() {
+        ostringstream out;
+        out << "decisions=" << latency.count << " p50_us=" << latency.percentile(50);
+        out << " p99_us=" << latency.percentile(99);
+        return out.str();
+    }
+
+private:
+    struct Connection {
+        string in, out;
+        bool dirty, writing;
+    };
+
+    int listen_fd, epoll_fd;
+    string path;
+    unordered_map<int, Connection> connections;
+    vector<int> dirty;
+    string error;
 
-        int total_1 = 0;
-        int total_2 = 0;
-        for (int i = 0; i < fifo.size(); i += 2) {
-            total_1 += fifo[i];
-            total_2 += fifo[i + 1];
+    bool watch(int fd, int op, unsigned events) {
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.fd = fd;
+        return epoll_ctl(epoll_fd, op, fd, &event) == 0;
+    }
+
+    void accept_clients() {
+        int fd;
+        while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK)) != -1) {
+            Connection& conn = connections[fd];
+            conn.dirty = false;
+            conn.writing = false;
+            watch(fd, EPOLL_CTL_ADD, EPOLLIN);
         }
-        int total_perc_1 = int(total_2 * 100 / float(total_1));
+    }
 
-        cout << "  Total";
-        for (int j = 0; j < maxdigs_task; j++) {
-            cout << " ";
+    void serve(int fd) {
+        /*
+         * Reads everything a client sent and answers every complete line in it.
+         */
+        unordered_map<int, Connection>::iterator it = connections.find(fd);
+        if (it == connections.end()) {
+            return;
         }
-        for (int j = 0; j < maxdigs_fifo - num_digs(total_1) + 3; j++) {
-            cout << " ";
+        Connection& conn = it->second;
+        bool closed = false;
+        char buffer[65536];
+        while (true) {
+            ssize_t len = read(fd, buffer, sizeof(buffer));
+            if (len > 0) {
+                conn.in.append(buffer, len);
+                continue;
+            } else if (len == -1 and errno == EINTR) {
+                continue;
+            }
+            closed = len == 0 or (errno != EAGAIN and errno != EWOULDBLOCK);
+            break;
         }
-        cout << total_1;
-        for (int j = 0; j < maxdigs_fifo - num_digs(total_2) + 3; j++) {
-            cout << " ";
+
+        // Each decision is timed from the end of the previous one, so one clock read is enough.
+        chrono::steady_clock::time_point last = chrono::steady_clock::now();
+        size_t start = 0, end;
+        while ((end = conn.in.find('\n', start)) != string::npos) {
+            handle(fd, conn, conn.in.data() + start, end - start);
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            latency.record(chrono::duration_cast<chrono::nanoseconds>(now - last).count());
+            last = now;
+            start = end + 1;
         }
-        cout << total_2;
-        for (int j = 0; j < maxdigs_fifo + 3 - num_digs(total_perc_1); j++) {
-            cout << " ";
+        conn.in.erase(0, start);
+
+        if (closed) {
+            controller.disconnect(fd);
+            notify_granted();
+            close(fd);
+            connections.erase(fd);
         }
-        cout << total_perc_1 << "%";
+    }
 
-        cout << "  ";
+    void handle(int fd, Connection& conn, const char* line, size_t len) {
+        // Answers a single message.
+        const char* end = line + len;
+        const char* word = line;
+        while (word < end and isspace(*word)) word++;
+        const char* word_end = word;
+        while (word_end < end and !isspace(*word_end)) word_end++;
+        if (word == end) {
+            return;
+        }
 
-        int total_3 = 0;
-        int total_4 = 0;
-        for (int i = 0; i < bankers.size(); i += 2) {
-            total_3 += bankers[i];
-            total_4 += bankers[i + 1];
+        if (word_end - word == 5 and memcmp(word, "stats", 5) == 0) {
+            reply(fd, conn, "stats " + stats());
+            return;
         }
-        int total_perc_2 = int(total_4 * 100 / float(total_3));
 
-        cout << "  Total";
-        for (int j = 0; j < maxdigs_task; j++) {
-            cout << " ";
+        // Read up to three numbers after the word, which must fit in an int.
+        long args[3] = {0, 0, 0};
+        int num_args = 0;
+        bool in_range = true;
+        const char* pos = word_end;
+        while (num_args < 3) {
+            while (pos < end and isspace(*pos)) pos++;
+            if (pos == end or !(isdigit(*pos) or *pos == '-')) break;
+            char* next;
+            args[num_args] = strtol(pos, &next, 10);
+            in_range = in_range and args[num_args] >= INT_MIN and args[num_args] <= INT_MAX;
+            num_args++;
+            pos = next;
         }
-        for (int j = 0; j < maxdigs_bankers - num_digs(total_3) + 3; j++) {
-            cout << " ";
+
+        Opcode opcode = get_opcode(word, word_end - word);
+        int needed = opcode == OP_TERMINATE ? 1 : 3;
+        Decision decision;
+        if (opcode == OP_INVALID or opcode == OP_ALSO or num_args < needed) {
+            error = "invalid message";
+            decision = DECISION_ERROR;
+        } else if (!in_range) {
+            error = "number out of range";
+            decision = DECISION_ERROR;
+        } else if (opcode == OP_INITIATE) {
+            decision = controller.initiate(args[0], fd, args[1], args[2], error);
+        } else if (opcode == OP_REQUEST) {
+            decision = controller.request(args[0], fd, args[1], args[2], error);
+        } else if (opcode == OP_RELEASE) {
+            decision = controller.release(args[0], fd, args[1], args[2], error);
+        } else {
+            decision = controller.terminate(args[0], fd, error);
         }
-        cout << total_3;
-        for (int j = 0; j < maxdigs_bankers - num_digs(total_4) + 3; j++) {
-            cout << " ";
+
+        if (decision == DECISION_ERROR) {
+            reply(fd, conn, "error " + error);
+        } else {
+            static const char* const words[] = {"grant ", "wait ", "abort ", "ok "};
+            conn.out += words[decision];
+            append_int(conn.out, args[0]);
+            conn.out += '\n';
+            mark_dirty(fd, conn);
         }
-        cout << total_4;
-        for (int j = 0; j < maxdigs_bankers + 3 - num_digs(total_perc_2); j++) {
-            cout << " ";
+        notify_granted();
+    }
+
+    void notify_granted() {
+        // Tells the owners of the waiting requests just granted.
+        for (int slot: controller.granted) {
+            int owner_fd = controller.owner[slot];
+            unordered_map<int, Connection>::iterator it = connections.find(owner_fd);
+            if (it != connections.end()) {
+                it->second.out += "grant ";
+                append_int(it->second.out, controller.task_id[slot]);
+                it->second.out += '\n';
+                mark_dirty(owner_fd, it->second);
+            }
         }
-        cout << total_perc_2 << "%";
+        controller.granted.clear();
+    }
 
-        cout << endl;
+    void reply(int fd, Connection& conn, const string& line) {
+        conn.out += line;
+        conn.out += '\n';
+        mark_dirty(fd, conn);
     }
 
-    void reset() {
+    void mark_dirty(int fd, Connection& conn) {
+        if (!conn.dirty) {
+            conn.dirty = true;
+            dirty.emplace_back(fd);
+        }
+    }
+
+    void flush(int fd) {
         /*
-         * Sets all the values to their initial positions after an algorithm has
-         * already been completed for the next algorithm to do so as well.
+         * Writes as much of a client's pending replies as the socket takes, and
+         * waits for it to be writable again if that is not all of them.
          */
-
-        task_list.clear();
-        total_res_list.clear();
-        current_res_list.clear();
-        instr_list.clear();
-
-        int num_tasks = stoi(original_input[0]);
-        for (int i = 0; i < num_tasks; i++) {
-            task_list.emplace_back(Task());
+        unordered_map<int, Connection>::iterator it = connections.find(fd);
+        if (it == connections.end()) {
+            return;
         }
-
-        int res_types = stoi(original_input[1]);
-        for (int i = 0; i < res_types; i++) {
-            total_res_list.emplace_back(stoi(original_input[2 + i]));
+        Connection& conn = it->second;
+        conn.dirty = false;
+        size_t sent = 0;
+        while (sent < conn.out.size()) {
+            ssize_t len = send(fd, conn.out.data() + sent, conn.out.size() - sent, MSG_NOSIGNAL);
+            if (len <= 0) {
+                break;
+            }
+            sent += len;
         }
-        current_res_list = total_res_list;
+        conn.out.erase(0, sent);
 
-        for (int i = 2 + res_types; i < original_input.size(); i = i + 5) {
-            instr_list.emplace_back(Instruction(original_input[i], stoi(original_input[i + 1]),
-                                                stoi(original_input[i + 2]), stoi(original_input[i + 3]),
-                                                stoi(original_input[i + 4])));
+        bool writing = !conn.out.empty();
+        if (writing != conn.writing) {
+            conn.writing = writing;
+            watch(fd, EPOLL_CTL_MOD, writing ? EPOLLIN | EPOLLOUT : EPOLLIN);
         }
-
-        cycle = 1;
     }
 };
 
 
+int run_server(const string& socket_path, const vector<int>& units) {
+    /*
+     * Runs the admission controller over a Unix domain socket until interrupted,
+     * then reports how long decisions took.
+     */
+    AdmissionServer server(units);
+    if (!server.open(socket_path)) {
+        cerr << "Cannot listen on " << socket_path << "." << endl;
+        return 2;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    cerr << "Serving " << units.size() << " resource types on " << socket_path << endl;
+    server.run();
+    cerr << server.stats() << endl;
+    return 0;
+}
+
+
+void write_results(const vector<ResManager*>& managers, const string& format, int num_tasks) {
+    /*
+     * Displays the messages of each run and the results on screen. The output is
+     * built in a single buffer (about a line per task) and written at once; the
+     * messages go to stderr when the output is meant for other programs.
+     */
+    string messages;
+    vector<const char*> names;
+    vector<const vector<TaskResult>*> runs;
+    for (ResManager* manager: managers) {
+        messages += manager->messages.str();
+        names.emplace_back(POLICY_KEYS[manager->policy]);
+        runs.emplace_back(&manager->results);
+    }
+    string out;
+    out.reserve(messages.size() + 64 * managers.size() * (num_tasks + 4));
+    if (format == "table") {
+        out += messages;
+        append_table(out, *runs[0], *runs[1]);
+    } else if (format == "csv") {
+        cerr << messages;
+        append_csv(out, names, runs);
+    } else {
+        cerr << messages;
+        append_json(out, names, runs);
+    }
+    cout.write(out.data(), out.size());
+    cout.flush();
+}
+
+
+bool apply_what_if(Checkpoint& checkpoint, const Program& program, const string& what_if) {
+    /*
+     * Makes every change of a comma separated list (see Checkpoint::apply).
+     */
+    istringstream in(what_if);
+    string change;
+    while (getline(in, change, ',')) {
+        if (!checkpoint.apply(change, program)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
 int main(int argc, char** argv) {
-    string file;
-    if (argc == 1) {
+    if (argc >= 2 and string(argv[1]) == "--serve") {
+        // The units present of every resource type follow the socket path.
+        vector<int> units;
+        for (int i = 3; i < argc; i++) {
+            units.emplace_back(atoi(argv[i]));
+            if (units.back() <= 0) {
+                units.clear();
+                break;
+            }
+        }
+        if (units.empty()) {
+            cerr << "Usage: resmanager --serve [socket_path] [units_of_type_1] [units_of_type_2] ..." << endl;
+            return 1;
+        }
+        return run_server(argv[2], units);
+    }
+    if (argc >= 2 and string(argv[1]) == "--compile") {
+        if (argc != 4) {
+            cerr << "Usage: resmanager --compile [input_file] [compiled_file]" << endl;
+            return 1;
+        }
+        return compile(argv[2], argv[3]);
+    }
+    if (argc >= 2 and string(argv[1]) == "--batch") {
+        if (argc == 2) {
+            cerr << "No input files given." << endl;
+            return 1;
+        }
+        return run_batch(vector<string>(argv + 2, argv + argc));
+    }
+
+    string file, trace_file, trace_format = "text", format = "table", policy_list = "fifo,bankers";
+    string save_file, restore_file;
+    vector<string> what_ifs;
+    long long checkpoint_cycle = 0;
+    bool timing = false, shard = false, checkpoint = false, explain_aborts = false;
+    VictimPolicy victim_policy = VICTIM_LOWEST;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--timing") {
+            timing = true;
+        } else if (arg == "--shard") {
+            shard = true;
+        } else if (arg == "--trace" and i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (arg == "--trace-format" and i + 1 < argc) {
+            trace_format = argv[++i];
+        } else if (arg.compare(0, 9, "--format=") == 0) {
+            format = arg.substr(9);
+        } else if (arg.compare(0, 11, "--policies=") == 0) {
+            policy_list = arg.substr(11);
+        } else if (arg.compare(0, 13, "--checkpoint=") == 0) {
+            checkpoint = true;
+            checkpoint_cycle = atoll(arg.c_str() + 13);
+        } else if (arg.compare(0, 7, "--save=") == 0) {
+            save_file = arg.substr(7);
+        } else if (arg.compare(0, 10, "--restore=") == 0) {
+            restore_file = arg.substr(10);
+        } else if (arg.compare(0, 10, "--what-if=") == 0) {
+            what_ifs.emplace_back(arg.substr(10));
+        } else if (arg.compare(0, 10, "--victims=") == 0) {
+            if (!parse_victim_policy(arg.substr(10), victim_policy)) {
+                cerr << "Unknown victim policy (use lowest, fewest-held, most-freed, least-progress or min-set)." << endl;
+                return 1;
+            }
+            explain_aborts = true;
+        } else {
+            file = arg;
+        }
+    }
+    if (file.empty()) {
         cerr << "No input file given." << endl;
         return 1;
-    } else if (argc >= 2) {
-        file = argv[1];
+    }
+    if (trace_format != "text" and trace_format != "chrome") {
+        cerr << "Unknown trace format (use text or chrome)." << endl;
+        return 1;
+    }
+    if (format != "table" and format != "csv" and format != "json") {
+        cerr << "Unknown output format (use table, csv or json)." << endl;
+        return 1;
+    }
+    vector<Policy> policies;
+    if (!parse_policies(policy_list, policies)) {
+        cerr << "Unknown policy (use fifo, bankers, srnf or batched)." << endl;
+        return 1;
+    }
+    if (shard and !trace_file.empty()) {
+        cerr << "Traces name tasks as in the whole input; --shard cannot be combined with --trace." << endl;
+        return 1;
+    }
+    if (format == "table" and policy_list != "fifo,bankers") {
+        cerr << "The table compares fifo and bankers; use --format=csv or json for other policies." << endl;
+        return 1;
+    }
+    if (checkpoint and checkpoint_cycle < 1) {
+        cerr << "The checkpoint cycle must be a positive number." << endl;
+        return 1;
+    }
+    if ((checkpoint and !restore_file.empty()) or (!save_file.empty() and !checkpoint)) {
+        cerr << "Use --checkpoint=N to stop at cycle N (and --save to keep it), or --restore to carry on from a file." << endl;
+        return 1;
+    }
+    if (!what_ifs.empty() and !checkpoint and restore_file.empty()) {
+        cerr << "A what-if starts from a checkpoint; give --checkpoint=N or --restore." << endl;
+        return 1;
+    }
+    if (shard and (checkpoint or !restore_file.empty())) {
+        cerr << "Checkpoints are of runs over the whole input; --shard cannot be combined with them." << endl;
+        return 1;
+    }
+    if (what_ifs.size() > 1 and !trace_file.empty()) {
+        cerr << "A trace follows a single set of runs; give at most one --what-if with --trace." << endl;
+        return 1;
     }
 
-    vector<string> input_vector = get_vector(file);
-    if (input_vector.empty()) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    InputFile input;
+    if (!input.open(file)) {
+        if (!input.found) {
+            cout << "File not found." << endl;
+        }
         cerr << "Invalid input file given." << endl;
         return 2;
     }
 
-    ResManager rm = ResManager(input_vector);
-    rm.execute();
+    Program program;
+    if (!program.load(input)) {
+        cerr << "Invalid input file given (" << input.error << ")." << endl;
+        return 2;
+    }
+    double parse_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // With --checkpoint, every policy first runs up to the start of the given cycle, and
+    // with --restore, the runs stopped there are read back. The runs after that start from
+    // there, once per what-if with its changes made, without going over the cycles before.
+    vector<Checkpoint> checkpoints;
+    double checkpoint_seconds = 0;
+    if (checkpoint) {
+        vector<unique_ptr<ResManager> > owned;
+        vector<ResManager*> managers;
+        for (Policy policy: policies) {
+            owned.emplace_back(new_manager(program, policy));
+            owned.back()->stop_at(checkpoint_cycle);
+            owned.back()->victim_policy = victim_policy;
+            owned.back()->explain_aborts = explain_aborts;
+            managers.emplace_back(owned.back().get());
+        }
+        execute_all(managers);
+        for (ResManager* manager: managers) {
+            if (!manager->stopped) {
+                cerr << "The " << POLICY_KEYS[manager->policy] << " run ends before cycle " << checkpoint_cycle << "." << endl;
+                return 1;
+            }
+            checkpoints.emplace_back(manager->checkpoint);
+            checkpoint_seconds = max(checkpoint_seconds, manager->seconds);
+        }
+        if (!save_file.empty() and !write_checkpoints(save_file, program, checkpoints)) {
+            cerr << "Cannot write the checkpoint file." << endl;
+            return 2;
+        }
+    } else if (!restore_file.empty()) {
+        if (!read_checkpoints(restore_file, program, checkpoints)) {
+            cerr << "Invalid checkpoint file given (unreadable, or not written for this input)." << endl;
+            return 2;
+        }
+        policies.clear();
+        for (const Checkpoint& restored: checkpoints) {
+            policies.emplace_back(restored.policy);
+        }
+        if (format == "table" and policies != vector<Policy>{POLICY_FIFO, POLICY_BANKERS}) {
+            cerr << "The table compares fifo and bankers; use --format=csv or json for other policies." << endl;
+            return 1;
+        }
+    }
+    if (what_ifs.empty()) {
+        what_ifs.emplace_back("");
+    }
+
+    // Every what-if makes its changes to copies of the checkpoints, reusing the same
+    // buffers. All of them are checked before anything runs.
+    vector<Checkpoint> forks;
+    for (const string& what_if: what_ifs) {
+        forks = checkpoints;
+        for (Checkpoint& fork: forks) {
+            if (!apply_what_if(fork, program, what_if)) {
+                cerr << "Cannot make the what-if " << what_if << " under " << POLICY_KEYS[fork.policy];
+                cerr << " (use delay:TASK:CYCLES or units:RESOURCE:TOTAL, separated by commas)." << endl;
+                return 1;
+            }
+        }
+    }
+
+    // With --shard, each policy runs over the connected components of the input in parallel.
+    Partition partition;
+    if (shard) {
+        partition.build(program);
+    }
+
+    for (const string& what_if: what_ifs) {
+        forks = checkpoints;
+        for (Checkpoint& fork: forks) {
+            apply_what_if(fork, program, what_if);
+        }
+
+        // Resolve all tasks using every policy (FIFO and Banker's unless told otherwise) at the same time.
+        vector<unique_ptr<ResManager> > owned;
+        vector<ResManager*> managers;
+        for (int p = 0; p < policies.size(); p++) {
+            if (!checkpoints.empty()) {
+                owned.emplace_back(new_manager(program, policies[p]));
+                owned.back()->resume(forks[p]);
+            } else if (shard) {
+                owned.emplace_back(new ShardedManager(program, policies[p], partition));
+            } else {
+                owned.emplace_back(new_manager(program, policies[p]));
+            }
+            owned.back()->victim_policy = victim_policy;
+            owned.back()->explain_aborts = explain_aborts;
+            managers.emplace_back(owned.back().get());
+        }
+
+        // In trace mode, every event of every run is written out by a background thread.
+        TraceWriter tracer;
+        if (!trace_file.empty()) {
+            if (!tracer.open(trace_file, trace_format == "chrome")) {
+                cerr << "Cannot write the trace file." << endl;
+                return 2;
+            }
+            for (ResManager* manager: managers) {
+                manager->trace_ring = tracer.add_run(POLICY_TRACE_NAMES[manager->policy]);
+            }
+            if (!tracer.start()) {
+                cerr << "Cannot write the trace file." << endl;
+                return 2;
+            }
+        }
+        if (shard) {
+            // Every policy already spreads its components over all the cores.
+            for (ResManager* manager: managers) {
+                manager->execute();
+            }
+        } else {
+            execute_all(managers);
+        }
+        if (!trace_file.empty()) {
+            tracer.finish();
+        }
+
+        if (!what_if.empty()) {
+            (format == "table" ? cout : cerr) << "What if " << what_if << ":" << endl;
+        }
+        write_results(managers, format, program.num_tasks);
+
+        // With --shard, report the components found and whether each policy could use them.
+        if (shard) {
+            cerr << partition.describe();
+            for (ResManager* manager: managers) {
+                cerr << " " << POLICY_KEYS[manager->policy] << "=";
+                cerr << (static_cast<ShardedManager*>(manager)->unsharded ? "unsharded" : "sharded");
+            }
+            cerr << endl;
+        }
+
+        // With --timing, report how long each phase took, in milliseconds.
+        if (timing) {
+            cerr << "parse_ms=" << parse_seconds * 1000;
+            if (checkpoint) {
+                cerr << " checkpoint_ms=" << checkpoint_seconds * 1000;
+            }
+            for (ResManager* manager: managers) {
+                cerr << " " << POLICY_KEYS[manager->policy] << "_ms=" << manager->seconds * 1000;
+            }
+            cerr << endl;
+        }
+    }
 
     return 0;
 }
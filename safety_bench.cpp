@@ -0,0 +1,73 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "safety_kernel.h"
+using namespace std;
+
+
+double time_pass(const SafetyKernel& kernel, const vector<int>& need, const vector<int>& held,
+                 const vector<int>& start, int num_tasks, int num_res, int repeats, long long& checksum) {
+    /*
+     * Times repeated passes of the safety algorithm's inner loop over every task:
+     * check whether its need fits and, if it does, return its held units. Returns
+     * the average nanoseconds spent per task row.
+     */
+    vector<int> available(num_res);
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    for (int rep = 0; rep < repeats; rep++) {
+        available = start;
+        for (int t = 0; t < num_tasks; t++) {
+            if (kernel.fits(&need[t * num_res], &available[0], num_res)) {
+                kernel.add(&available[0], &held[t * num_res], num_res);
+                checksum += t;
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    return seconds * 1e9 / (double(repeats) * num_tasks);
+}
+
+
+int main() {
+    // Rows are built so that almost every task fits, as in a safe state, which
+    // makes every check scan its whole row.
+    const int num_tasks = 1024;
+    const char* names[] = {"scalar", "sse2", "avx2"};
+    mt19937 rng(12345);
+
+    cout << "safety kernel picked at runtime: " << safety_kernel().name << endl;
+    cout << setw(6) << "R" << setw(10) << "variant" << setw(12) << "ns/row" << setw(10) << "speedup" << endl;
+    for (int num_res: {8, 64, 512}) {
+        vector<int> need(num_tasks * num_res), held(num_tasks * num_res), start(num_res, 1000);
+        for (int i = 0; i < num_tasks * num_res; i++) {
+            need[i] = rng() % 1000;
+            held[i] = rng() % 4;
+        }
+        int repeats = max(1, (1 << 26) / (num_tasks * num_res));
+
+        double scalar_ns = 0;
+        long long reference = -1;
+        for (const char* name: names) {
+            const SafetyKernel* kernel = find_safety_kernel(name);
+            if (kernel == NULL) {
+                cout << setw(6) << num_res << setw(10) << name << setw(12) << "n/a" << endl;
+                continue;
+            }
+
+            long long checksum = 0;
+            double ns = time_pass(*kernel, need, held, start, num_tasks, num_res, repeats, checksum);
+            if (reference == -1) {
+                reference = checksum;
+                scalar_ns = ns;
+            } else if (checksum != reference) {
+                cerr << name << " disagrees with the scalar kernel at R = " << num_res << endl;
+                return 1;
+            }
+            cout << setw(6) << num_res << setw(10) << name << setw(12) << fixed << setprecision(2) << ns;
+            cout << setw(9) << setprecision(2) << scalar_ns / ns << "x" << endl;
+        }
+    }
+    return 0;
+}
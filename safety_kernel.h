@@ -0,0 +1,173 @@
+#ifndef SAFETY_KERNEL_H
+#define SAFETY_KERNEL_H
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) or defined(__i386__)
+#include <immintrin.h>
+#define SAFETY_KERNEL_X86
+#endif
+
+
+/*
+ * The row operations the Banker's safety algorithm spends its time on, once per
+ * task and pass over the live tasks: checking whether a task's remaining claims
+ * fit in the available units, and returning its held units when they do. Rows
+ * are num_res ints long. Every variant computes exactly the same thing; the
+ * vectorized ones compare 4 (SSE2) or 8 (AVX2) resource types at a time.
+ */
+struct SafetyKernel {
+    const char* name;
+    bool (*fits)(const int* need, const int* available, int num_res);
+    void (*add)(int* available, const int* held, int num_res);
+};
+
+
+inline bool row_fits_scalar(const int* need, const int* available, int num_res) {
+    // Returns whether need[r] <= available[r] for every resource type r.
+    for (int r = 0; r < num_res; r++) {
+        if (need[r] > available[r]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void row_add_scalar(int* available, const int* held, int num_res) {
+    // Adds held[r] to available[r] for every resource type r.
+    for (int r = 0; r < num_res; r++) {
+        available[r] += held[r];
+    }
+}
+
+
+#ifdef SAFETY_KERNEL_X86
+inline bool row_fits_sse2(const int* need, const int* available, int num_res) {
+    int r = 0;
+    for (; r + 4 <= num_res; r += 4) {
+        __m128i n = _mm_loadu_si128((const __m128i*) (need + r));
+        __m128i a = _mm_loadu_si128((const __m128i*) (available + r));
+        if (_mm_movemask_epi8(_mm_cmpgt_epi32(n, a)) != 0) {
+            return false;
+        }
+    }
+    return row_fits_scalar(need + r, available + r, num_res - r);
+}
+
+inline void row_add_sse2(int* available, const int* held, int num_res) {
+    int r = 0;
+    for (; r + 4 <= num_res; r += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (available + r));
+        __m128i h = _mm_loadu_si128((const __m128i*) (held + r));
+        _mm_storeu_si128((__m128i*) (available + r), _mm_add_epi32(a, h));
+    }
+    row_add_scalar(available + r, held + r, num_res - r);
+}
+
+__attribute__((target("avx2")))
+inline bool row_fits_avx2(const int* need, const int* available, int num_res) {
+    int r = 0;
+    for (; r + 8 <= num_res; r += 8) {
+        __m256i n = _mm256_loadu_si256((const __m256i*) (need + r));
+        __m256i a = _mm256_loadu_si256((const __m256i*) (available + r));
+        __m256i over = _mm256_cmpgt_epi32(n, a);
+        if (!_mm256_testz_si256(over, over)) {
+            return false;
+        }
+    }
+    return row_fits_sse2(need + r, available + r, num_res - r);
+}
+
+__attribute__((target("avx2")))
+inline void row_add_avx2(int* available, const int* held, int num_res) {
+    int r = 0;
+    for (; r + 8 <= num_res; r += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i*) (available + r));
+        __m256i h = _mm256_loadu_si256((const __m256i*) (held + r));
+        _mm256_storeu_si256((__m256i*) (available + r), _mm256_add_epi32(a, h));
+    }
+    row_add_sse2(available + r, held + r, num_res - r);
+}
+#endif
+
+
+inline const SafetyKernel* find_safety_kernel(const char* name) {
+    /*
+     * Returns the variant with the given name ("scalar", "sse2" or "avx2"), or
+     * NULL if it does not exist or the processor cannot run it.
+     */
+    static const SafetyKernel scalar = {"scalar", row_fits_scalar, row_add_scalar};
+    if (strcmp(name, "scalar") == 0) {
+        return &scalar;
+    }
+
+#ifdef SAFETY_KERNEL_X86
+    static const SafetyKernel sse2 = {"sse2", row_fits_sse2, row_add_sse2};
+    static const SafetyKernel avx2 = {"avx2", row_fits_avx2, row_add_avx2};
+    if (strcmp(name, "sse2") == 0 and __builtin_cpu_supports("sse2")) {
+        return &sse2;
+    }
+    if (strcmp(name, "avx2") == 0 and __builtin_cpu_supports("avx2")) {
+        return &avx2;
+    }
+#endif
+    return NULL;
+}
+
+
+inline const SafetyKernel& safety_kernel() {
+    /*
+     * The fastest variant the processor supports, picked on first use. Setting
+     * RESMANAGER_KERNEL to the name of a variant forces that one instead.
+     */
+    static const SafetyKernel* kernel = [] {
+        const char* forced = getenv("RESMANAGER_KERNEL");
+        if (forced != NULL and find_safety_kernel(forced) != NULL) {
+            return find_safety_kernel(forced);
+        }
+        const SafetyKernel* best = find_safety_kernel("avx2");
+        if (best == NULL) {
+            best = find_safety_kernel("sse2");
+        }
+        return best != NULL ? best : find_safety_kernel("scalar");
+    }();
+    return *kernel;
+}
+
+
+inline bool find_safe_sequence(const int* need, const int* held, int num_res, const std::vector<int>& live,
+                               std::vector<int>& available, std::vector<bool>& done, std::vector<int>& sequence) {
+    /*
+     * The safety algorithm of Banker's: repeatedly lets any live task whose
+     * remaining claims (need, a row of num_res per task) fit in the available
+     * units finish and return the units it holds. Leaves the order in which the
+     * tasks finished in sequence, and returns whether every live task could.
+     * done must already have an entry per task.
+     */
+    const SafetyKernel& kernel = safety_kernel();
+    sequence.clear();
+    for (int t: live) {
+        done[t] = false;
+    }
+
+    bool progress = true;
+    while (progress and sequence.size() < live.size()) {
+        progress = false;
+        for (int t: live) {
+            if (done[t]) {
+                continue;
+            }
+            if (kernel.fits(&need[t * num_res], &available[0], num_res)) {
+                kernel.add(&available[0], &held[t * num_res], num_res);
+                done[t] = true;
+                sequence.emplace_back(t);
+                progress = true;
+            }
+        }
+    }
+    return sequence.size() == live.size();
+}
+
+#endif
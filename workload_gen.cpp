@@ -0,0 +1,152 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+using namespace std;
+
+
+class WorkloadConfig {
+    /*
+     * The shape of a generated workload. Every field can be set from the command
+     * line with --<name> <value>, e.g. --tasks 1000.
+     */
+public:
+    int tasks, resources, units, requests, delay_max, groups;
+    double tightness, granularity, delay_prob;
+    unsigned seed;
+
+    WorkloadConfig() {
+        tasks = 10;          // Number of tasks.
+        resources = 2;       // Number of resource types.
+        units = 10;          // Units present of every resource type.
+        requests = 5;        // Requests made by every task, each followed at some point by its release.
+        delay_max = 5;       // Longest delay of a delayed instruction.
+        tightness = 0.5;     // Fraction of the units present that a task claims at most.
+        granularity = 0.5;   // Fraction of its claim that a single request asks for at most.
+        delay_prob = 0.2;    // Probability of an instruction being delayed.
+        groups = 1;          // Groups of tasks using disjoint sets of resource types.
+        seed = 1;
+    }
+
+    bool parse(int argc, char** argv) {
+        // Reads the options given on the command line. Returns false on an unknown or incomplete one.
+        for (int i = 1; i < argc; i += 2) {
+            if (i + 1 == argc) {
+                return false;
+            }
+            string name = argv[i];
+            double value = atof(argv[i + 1]);
+            if (name == "--tasks") tasks = value;
+            else if (name == "--resources") resources = value;
+            else if (name == "--units") units = value;
+            else if (name == "--requests") requests = value;
+            else if (name == "--delay-max") delay_max = value;
+            else if (name == "--tightness") tightness = value;
+            else if (name == "--granularity") granularity = value;
+            else if (name == "--delay-prob") delay_prob = value;
+            else if (name == "--groups") groups = value;
+            else if (name == "--seed") seed = value;
+            else return false;
+        }
+        return tasks > 0 and resources > 0 and units > 0 and requests >= 0 and delay_max >= 0 and
+               groups > 0 and groups <= resources;
+    }
+};
+
+
+class WorkloadGenerator {
+    /*
+     * Writes valid inputs: every task initiates every resource type with a claim
+     * that never exceeds the units present, only requests what its claim still
+     * allows and releases everything it holds before terminating, so both FIFO and
+     * Banker's can always run it to completion (FIFO through deadlock aborts).
+     * With several groups, task t only uses the resource types of group t mod
+     * groups, which split the types into contiguous ranges.
+     */
+public:
+    explicit WorkloadGenerator(const WorkloadConfig& conf) : config(conf), rng(conf.seed) {}
+
+    void write(ostream& out) {
+        out << config.tasks << " " << config.resources;
+        for (int r = 0; r < config.resources; r++) {
+            out << " " << config.units;
+        }
+        out << "\n";
+
+        for (int t = 1; t <= config.tasks; t++) {
+            write_task(out, t);
+        }
+    }
+
+private:
+    const WorkloadConfig& config;
+    mt19937 rng;
+
+    int uniform(int lo, int hi) {
+        return uniform_int_distribution<int>(lo, hi)(rng);
+    }
+
+    int delay() {
+        if (config.delay_max == 0 or uniform_real_distribution<double>(0, 1)(rng) >= config.delay_prob) {
+            return 0;
+        }
+        return uniform(1, config.delay_max);
+    }
+
+    void write_task(ostream& out, int task) {
+        int max_claim = max(1, int(config.units * config.tightness));
+        int group = task % config.groups;
+        int first = long(config.resources) * group / config.groups;
+        int last = long(config.resources) * (group + 1) / config.groups;
+        vector<int> claims(config.resources, 0), held(config.resources, 0);
+        for (int r = first; r < last; r++) {
+            claims[r] = uniform(1, min(max_claim, config.units));
+            out << "initiate " << task << " 0 " << r + 1 << " " << claims[r] << "\n";
+        }
+
+        // Interleave requests and releases, releasing part of a holding at random.
+        for (int i = 0; i < config.requests; i++) {
+            int r = uniform(first, last - 1);
+            if (held[r] > 0 and uniform(0, 2) == 0) {
+                int num = uniform(1, held[r]);
+                held[r] -= num;
+                out << "release " << task << " " << delay() << " " << r + 1 << " " << num << "\n";
+            }
+            if (held[r] == claims[r]) {
+                continue;
+            }
+            int largest = max(1, int(claims[r] * config.granularity));
+            int num = uniform(1, min(largest, claims[r] - held[r]));
+            held[r] += num;
+            out << "request " << task << " " << delay() << " " << r + 1 << " " << num << "\n";
+        }
+
+        for (int r = first; r < last; r++) {
+            if (held[r] > 0) {
+                out << "release " << task << " " << delay() << " " << r + 1 << " " << held[r] << "\n";
+            }
+        }
+        out << "terminate " << task << " " << delay() << " 0 0\n";
+    }
+};
+
+
+int main(int argc, char** argv) {
+    WorkloadConfig config;
+    if (!config.parse(argc, argv)) {
+        cerr << "Usage: workload_gen [--tasks N] [--resources R] [--units U] [--requests K]" << endl;
+        cerr << "                    [--tightness F] [--granularity F] [--delay-prob P] [--delay-max D]" << endl;
+        cerr << "                    [--groups G] [--seed S]" << endl;
+        return 1;
+    }
+
+    // Build the whole file in memory and write it at once.
+    ostringstream out;
+    WorkloadGenerator(config).write(out);
+    cout << out.str();
+    return 0;
+}